@@ -2,3 +2,5 @@
 
 option(BUILD_TESTING "Build & run automated tests." OFF)
 option(BUILD_DOCUMENTATION "Build doxygen documentation." OFF)
+option(EULER_ENABLE_PROFILING "Compile the profiling macros into instrumented code." ON)
+option(EULER_ENABLE_ALLOCATION_TRACKING "Replace the global operator new and delete, to attribute heap allocations to profiled regions." OFF)
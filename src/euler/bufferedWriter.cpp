@@ -0,0 +1,63 @@
+#include "bufferedWriter.h"
+
+BufferedWriter::BufferedWriter(size_t i_capacity)
+{
+    m_buffer.resize(i_capacity);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    Close();
+}
+
+bool BufferedWriter::Open(const char* i_path)
+{
+    Close();
+    m_file = fopen(i_path, "wb");
+    m_failed = m_file == nullptr;
+    return !m_failed;
+}
+
+bool BufferedWriter::Close()
+{
+    if (m_file != nullptr) {
+        Flush();
+        if (fclose(m_file) != 0) {
+            m_failed = true;
+        }
+        m_file = nullptr;
+    }
+
+    return !m_failed;
+}
+
+void BufferedWriter::WriteUnsigned(uint64_t i_value)
+{
+    // Digits are produced in reverse order, into the back of a scratch buffer.
+    char digits[20];
+    char* digit = digits + sizeof(digits);
+    do {
+        *--digit = '0' + (i_value % 10);
+        i_value /= 10;
+    } while (i_value != 0);
+
+    Write(digit, digits + sizeof(digits) - digit);
+}
+
+void BufferedWriter::Flush()
+{
+    WriteUnbuffered(m_buffer.data(), m_size);
+    m_size = 0;
+}
+
+void BufferedWriter::WriteUnbuffered(const void* i_data, size_t i_size)
+{
+    if (m_file == nullptr) {
+        m_failed = true;
+        return;
+    }
+
+    if (i_size > 0 && fwrite(i_data, 1, i_size, m_file) != i_size) {
+        m_failed = true;
+    }
+}
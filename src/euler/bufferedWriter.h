@@ -0,0 +1,74 @@
+#pragma once
+
+/// \file bufferedWriter.h
+///
+/// Buffered file output for streaming large exports.
+
+#include <euler/api.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/// \class BufferedWriter
+///
+/// Accumulates written bytes into a large buffer which is only handed to the
+/// file once full, so that exports of millions of small fields are not bound
+/// by per-call stdio overhead.
+///
+/// Errors are sticky, and reported by Close().
+class EULER_API BufferedWriter final
+{
+public:
+    explicit BufferedWriter(size_t i_capacity = 1 << 20);
+    ~BufferedWriter();
+
+    // Cannot be copied.
+    BufferedWriter(const BufferedWriter& i_writer) = delete;
+    BufferedWriter& operator=(const BufferedWriter& i_writer) = delete;
+
+    /// Open \p i_path for writing, truncating any existing content.
+    ///
+    /// \return false if the file could not be opened.
+    bool Open(const char* i_path);
+
+    /// Flush the buffered bytes and close the file.
+    ///
+    /// \return false if any write since Open() has failed.
+    bool Close();
+
+    /// Write \p i_size bytes of \p i_data.
+    void Write(const void* i_data, size_t i_size)
+    {
+        if (m_size + i_size > m_buffer.size()) {
+            Flush();
+            if (i_size > m_buffer.size()) {
+                WriteUnbuffered(i_data, i_size);
+                return;
+            }
+        }
+
+        memcpy(m_buffer.data() + m_size, i_data, i_size);
+        m_size += i_size;
+    }
+
+    /// Write the null-terminated \p i_string, excluding its terminator.
+    void Write(const char* i_string) { Write(i_string, strlen(i_string)); }
+
+    /// Write the decimal representation of \p i_value.
+    void WriteUnsigned(uint64_t i_value);
+
+private:
+    /// Hand the buffered bytes to the file.
+    void Flush();
+
+    /// Write \p i_data directly to the file.
+    void WriteUnbuffered(const void* i_data, size_t i_size);
+
+    FILE* m_file = nullptr;
+    bool m_failed = false;
+    std::vector<char> m_buffer;
+    size_t m_size = 0;
+};
@@ -10,4 +10,7 @@
 ///
 /// When NDEBUG is \em not defined, abort the application if
 /// the expression passed into ASSERT(...) does not evaluate to \p true.
+///
+/// The abort raises SIGABRT, upon which the profiler writes its records to a
+/// crash trace, if set up with ProfilerOptions::m_crashPath.
 #define ASSERT(expr) assert(expr);
@@ -0,0 +1,58 @@
+#include "histogram.h"
+
+#include <cmath>
+
+void LogLinearHistogram::Merge(const LogLinearHistogram& i_histogram)
+{
+    for (uint32_t bucketIndex = 0; bucketIndex < c_bucketCount;
+         ++bucketIndex) {
+        m_counts[bucketIndex] += i_histogram.m_counts[bucketIndex];
+    }
+    m_totalCount += i_histogram.m_totalCount;
+}
+
+uint64_t LogLinearHistogram::GetValueAtPercentile(double i_percentile) const
+{
+    if (m_totalCount == 0) {
+        return 0;
+    }
+
+    // The rank of the occurrence at the percentile, counting from 1.
+    uint64_t rank =
+        (uint64_t)std::ceil(i_percentile / 100.0 * (double)m_totalCount);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t cumulativeCount = 0;
+    for (uint32_t bucketIndex = 0; bucketIndex < c_bucketCount;
+         ++bucketIndex) {
+        cumulativeCount += m_counts[bucketIndex];
+        if (cumulativeCount >= rank) {
+            return GetBucketUpperBound(bucketIndex);
+        }
+    }
+
+    return GetBucketUpperBound(c_bucketCount - 1);
+}
+
+uint64_t LogLinearHistogram::GetBucketLowerBound(uint32_t i_bucketIndex)
+{
+    uint32_t block = i_bucketIndex >> c_subBucketBits;
+    uint64_t subBucket = i_bucketIndex & (c_subBucketCount - 1);
+    if (block == 0) {
+        return subBucket;
+    }
+
+    return (subBucket + c_subBucketCount) << (block - 1);
+}
+
+uint64_t LogLinearHistogram::GetBucketUpperBound(uint32_t i_bucketIndex)
+{
+    uint32_t block = i_bucketIndex >> c_subBucketBits;
+    if (block <= 1) {
+        return GetBucketLowerBound(i_bucketIndex);
+    }
+
+    return GetBucketLowerBound(i_bucketIndex) + (1ull << (block - 1)) - 1;
+}
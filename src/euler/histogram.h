@@ -0,0 +1,100 @@
+#pragma once
+
+/// \file histogram.h
+///
+/// Fixed-memory histogram for latency distributions.
+
+#include <euler/api.h>
+
+#include <array>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+/// \class LogLinearHistogram
+///
+/// Histogram of unsigned integer values, in the manner of HdrHistogram.
+///
+/// Values are bucketed by their power of two, and each power of two is split
+/// into \ref c_subBucketCount linear sub-buckets.  This bounds the relative
+/// error of any recorded value by 1 / \ref c_subBucketCount, using a fixed
+/// amount of memory.  Values beyond \ref c_maxValue are clamped into the last
+/// bucket.
+///
+/// Recording is not thread-safe: each thread is expected to record into its
+/// own histogram, to be merged upon reporting.
+class EULER_API LogLinearHistogram final
+{
+public:
+    /// Number of bits of precision kept for each value.
+    static constexpr uint32_t c_subBucketBits = 5;
+
+    /// Number of linear sub-buckets per power of two.
+    static constexpr uint32_t c_subBucketCount = 1u << c_subBucketBits;
+
+    /// Exclusive upper bound of the values which are bucketed exactly.
+    static constexpr uint32_t c_maxExponent = 48;
+    static constexpr uint64_t c_maxValue = 1ull << c_maxExponent;
+
+    /// Total number of buckets.
+    static constexpr uint32_t c_bucketCount =
+        (c_maxExponent - c_subBucketBits + 1) << c_subBucketBits;
+
+    /// Record a single occurrence of \p i_value.
+    void Record(uint64_t i_value)
+    {
+        ++m_counts[GetBucketIndex(i_value)];
+        ++m_totalCount;
+    }
+
+    /// Add the occurrences recorded by \p i_histogram.
+    void Merge(const LogLinearHistogram& i_histogram);
+
+    /// Get the total number of recorded occurrences.
+    uint64_t GetTotalCount() const { return m_totalCount; }
+
+    /// Get the value below or at which \p i_percentile percent of the recorded
+    /// occurrences lie.
+    ///
+    /// The highest value equivalent to the containing bucket is returned, or
+    /// 0 if the histogram is empty.
+    uint64_t GetValueAtPercentile(double i_percentile) const;
+
+    /// Get the index of the bucket containing \p i_value.
+    static uint32_t GetBucketIndex(uint64_t i_value)
+    {
+        if (i_value < c_subBucketCount) {
+            return (uint32_t)i_value;
+        } else if (i_value >= c_maxValue) {
+            return c_bucketCount - 1;
+        }
+
+        uint32_t shift = _FindLastSet(i_value) - c_subBucketBits;
+        return ((shift + 1) << c_subBucketBits) + (uint32_t)(i_value >> shift) -
+               c_subBucketCount;
+    }
+
+    /// Get the lowest value contained in the bucket at \p i_bucketIndex.
+    static uint64_t GetBucketLowerBound(uint32_t i_bucketIndex);
+
+    /// Get the highest value contained in the bucket at \p i_bucketIndex.
+    static uint64_t GetBucketUpperBound(uint32_t i_bucketIndex);
+
+private:
+    /// Get the index of the most significant set bit of non-zero \p i_value.
+    static uint32_t _FindLastSet(uint64_t i_value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, i_value);
+        return index;
+#else
+        return 63 - __builtin_clzll(i_value);
+#endif
+    }
+
+    std::array<uint64_t, c_bucketCount> m_counts{};
+    uint64_t m_totalCount = 0;
+};
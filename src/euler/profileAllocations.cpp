@@ -0,0 +1,187 @@
+#include "profileAllocations.h"
+
+#if EULER_ENABLE_ALLOCATION_TRACKING
+
+#    include <algorithm>
+#    include <cstddef>
+#    include <new>
+#    include <stdlib.h>
+
+/// Size of the header preceding allocations of fundamental alignment, which
+/// records their size and offset from the start of the underlying block.
+constexpr size_t c_allocationHeaderSize = alignof(std::max_align_t);
+
+static_assert(c_allocationHeaderSize >= 2 * sizeof(size_t),
+              "The allocation header must fit a size and an offset");
+
+// Allocate \p i_size bytes aligned to \p i_alignment, preceded by their
+// header, retrying through the new-handler like the default operator new.
+//
+// \return nullptr if out of memory and there is no new-handler.
+static void* _Allocate(size_t i_size, size_t i_alignment)
+{
+    // Over-aligned allocations keep the alignment of the pointer returned by
+    // offsetting it by a whole alignment.
+    size_t offset = std::max(i_alignment, c_allocationHeaderSize);
+    void* block = nullptr;
+    while (true) {
+        if (i_alignment <= c_allocationHeaderSize) {
+            block = malloc(offset + i_size);
+        } else if (posix_memalign(&block, i_alignment, offset + i_size) != 0) {
+            block = nullptr;
+        }
+        if (block != nullptr) {
+            break;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            return nullptr;
+        }
+        handler();
+    }
+
+    char* pointer = (char*)block + offset;
+    ((size_t*)pointer)[-2] = i_size;
+    ((size_t*)pointer)[-1] = offset;
+    ProfilerTrackAllocation(i_size);
+    return pointer;
+}
+
+// Free memory returned by _Allocate(), whatever its alignment.
+static void _Deallocate(void* i_pointer)
+{
+    if (i_pointer == nullptr) {
+        return;
+    }
+
+    size_t* header = (size_t*)i_pointer;
+    ProfilerTrackDeallocation(header[-2]);
+    free((char*)i_pointer - header[-1]);
+}
+
+// Allocate like operator new, throwing upon failure.
+static void* _AllocateOrThrow(size_t i_size, size_t i_alignment)
+{
+    void* pointer = _Allocate(i_size, i_alignment);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(size_t i_size)
+{
+    return _AllocateOrThrow(i_size, c_allocationHeaderSize);
+}
+
+void* operator new[](size_t i_size)
+{
+    return _AllocateOrThrow(i_size, c_allocationHeaderSize);
+}
+
+void* operator new(size_t i_size, const std::nothrow_t&) noexcept
+{
+    return _Allocate(i_size, c_allocationHeaderSize);
+}
+
+void* operator new[](size_t i_size, const std::nothrow_t&) noexcept
+{
+    return _Allocate(i_size, c_allocationHeaderSize);
+}
+
+void operator delete(void* i_pointer) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete[](void* i_pointer) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete(void* i_pointer, const std::nothrow_t&) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete[](void* i_pointer, const std::nothrow_t&) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete(void* i_pointer, size_t) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete[](void* i_pointer, size_t) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+// Over-aligned allocations, of C++17, are replaced alike, so that any form of
+// operator delete may free any allocation.
+#    if defined(__cpp_aligned_new)
+
+void* operator new(size_t i_size, std::align_val_t i_alignment)
+{
+    return _AllocateOrThrow(i_size, (size_t)i_alignment);
+}
+
+void* operator new[](size_t i_size, std::align_val_t i_alignment)
+{
+    return _AllocateOrThrow(i_size, (size_t)i_alignment);
+}
+
+void* operator new(size_t i_size,
+                   std::align_val_t i_alignment,
+                   const std::nothrow_t&) noexcept
+{
+    return _Allocate(i_size, (size_t)i_alignment);
+}
+
+void* operator new[](size_t i_size,
+                     std::align_val_t i_alignment,
+                     const std::nothrow_t&) noexcept
+{
+    return _Allocate(i_size, (size_t)i_alignment);
+}
+
+void operator delete(void* i_pointer, std::align_val_t) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete[](void* i_pointer, std::align_val_t) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete(void* i_pointer,
+                     std::align_val_t,
+                     const std::nothrow_t&) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete[](void* i_pointer,
+                       std::align_val_t,
+                       const std::nothrow_t&) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete(void* i_pointer, size_t, std::align_val_t) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+void operator delete[](void* i_pointer, size_t, std::align_val_t) noexcept
+{
+    _Deallocate(i_pointer);
+}
+
+#    endif
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+/// \file profileAllocations.h
+///
+/// Attribution of heap allocations to the innermost profiled region of the
+/// calling thread.
+///
+/// When built with EULER_ENABLE_ALLOCATION_TRACKING, the euler library
+/// replaces the global operator new and delete of the programs linking it,
+/// which report each allocation to these functions.  Other allocators may
+/// report to them likewise.
+
+#include <euler/api.h>
+
+#include <stddef.h>
+
+/// Account for \p i_bytes allocated on the heap by the calling thread.
+///
+/// Has no effect unless the profiler tracks allocations, and the calling
+/// thread has profiled a region.  Must not allocate.
+EULER_API
+void ProfilerTrackAllocation(size_t i_bytes);
+
+/// Account for \p i_bytes freed by the calling thread.
+EULER_API
+void ProfilerTrackDeallocation(size_t i_bytes);
@@ -0,0 +1,1011 @@
+#include "profileCapture.h"
+#include "bufferedWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#include <sstream>
+#include <stdio.h>
+#include <unordered_map>
+
+/// Sentinel index for records or stacks which are absent.
+constexpr uint32_t c_invalidIndex = UINT32_MAX;
+
+// Find the index of the enclosing record of each record of \p i_capture, or
+// c_invalidIndex if it is outermost or no longer recorded.
+static std::vector<uint32_t> _FindParentRecords(const ProfileCapture& i_capture)
+{
+    // Region identifiers are only unique within their thread.
+    auto regionKey = [](uint16_t i_thread, uint32_t i_id) {
+        return ((uint64_t)i_thread << 32) | i_id;
+    };
+
+    const std::vector<ProfileRecord>& records = i_capture.m_records;
+    std::unordered_map<uint64_t, uint32_t> recordIndices;
+    recordIndices.reserve(records.size());
+    for (uint32_t recordIndex = 0; recordIndex < records.size();
+         ++recordIndex) {
+        const ProfileRecord& record = records[recordIndex];
+        recordIndices[regionKey(record.m_thread, record.m_id)] = recordIndex;
+    }
+
+    std::vector<uint32_t> parentIndices(records.size(), c_invalidIndex);
+    for (uint32_t recordIndex = 0; recordIndex < records.size();
+         ++recordIndex) {
+        const ProfileRecord& record = records[recordIndex];
+        if (record.m_parent == 0) {
+            continue;
+        }
+
+        auto it = recordIndices.find(regionKey(record.m_thread, record.m_parent));
+        if (it != recordIndices.end()) {
+            parentIndices[recordIndex] = it->second;
+        }
+    }
+
+    return parentIndices;
+}
+
+// Compute the time spent in the directly enclosed records of each record of
+// \p i_capture, given the indices of their enclosing records.
+//
+// Enclosed records are scaled by their sampling rate, to estimate the time of
+// the entries which have been skipped.
+static std::vector<uint64_t>
+_ComputeChildTicks(const ProfileCapture& i_capture,
+                   const std::vector<uint32_t>& i_parentIndices)
+{
+    const std::vector<ProfileRecord>& records = i_capture.m_records;
+    std::vector<uint64_t> childTicks(records.size(), 0);
+    for (uint32_t recordIndex = 0; recordIndex < records.size();
+         ++recordIndex) {
+        uint32_t parentIndex = i_parentIndices[recordIndex];
+        if (parentIndex != c_invalidIndex) {
+            const ProfileRecord& record = records[recordIndex];
+            childTicks[parentIndex] +=
+                (record.m_stop - record.m_start) *
+                i_capture.m_sites[record.m_site].m_sampleRate;
+        }
+    }
+
+    return childTicks;
+}
+
+// Compute the duration of each record of \p i_capture corrected for the
+// calibrated overhead of the profiler within it, into \p o_ticks, along with
+// the corrected time spent in its directly enclosed records, into
+// \p o_childTicks, given the indices of their enclosing records.
+//
+// Records are ordered such that enclosed records follow their enclosing
+// record, so visiting them backwards accounts for every enclosed record first.
+static void _ComputeCorrectedTicks(const ProfileCapture& i_capture,
+                                   const std::vector<uint32_t>& i_parentIndices,
+                                   std::vector<uint64_t>& o_ticks,
+                                   std::vector<uint64_t>& o_childTicks)
+{
+    const std::vector<ProfileRecord>& records = i_capture.m_records;
+    double scopeTicks =
+        i_capture.m_scopeOverheadNanoseconds / i_capture.m_nanosecondsPerTick;
+    double nestingTicks =
+        i_capture.m_nestingOverheadNanoseconds / i_capture.m_nanosecondsPerTick;
+    std::vector<double> overheadTicks(records.size(), 0.0);
+    o_ticks.assign(records.size(), 0);
+    o_childTicks.assign(records.size(), 0);
+    for (uint32_t recordIndex = records.size(); recordIndex-- > 0;) {
+        const ProfileRecord& record = records[recordIndex];
+        double ticks = (double)(record.m_stop - record.m_start) - scopeTicks -
+                       overheadTicks[recordIndex];
+        o_ticks[recordIndex] = ticks > 0.0 ? (uint64_t)ticks : 0;
+
+        uint32_t parentIndex = i_parentIndices[recordIndex];
+        if (parentIndex != c_invalidIndex) {
+            overheadTicks[parentIndex] +=
+                nestingTicks + overheadTicks[recordIndex];
+            o_childTicks[parentIndex] +=
+                o_ticks[recordIndex] *
+                i_capture.m_sites[record.m_site].m_sampleRate;
+        }
+    }
+}
+
+/// \class ProfileAsyncSpan
+///
+/// An asynchronous span of a capture, given by the indices of the samples at
+/// either end.
+class ProfileAsyncSpan
+{
+public:
+    uint32_t m_begin = 0;
+    uint32_t m_end = 0;
+};
+
+// Pair the ends of the asynchronous spans of \p i_capture by identifier, in
+// order of their end.
+//
+// Identifiers may be reused once their span has ended.  Spans which have yet
+// to end, or whose beginning is no longer recorded, are left out.
+static std::vector<ProfileAsyncSpan>
+_MatchAsyncSpans(const ProfileCapture& i_capture)
+{
+    std::vector<ProfileAsyncSpan> spans;
+    std::unordered_map<uint64_t, uint32_t> beginIndices;
+    for (uint32_t sampleIndex = 0; sampleIndex < i_capture.m_samples.size();
+         ++sampleIndex) {
+        const ProfileSample& sample = i_capture.m_samples[sampleIndex];
+        if (sample.m_kind == ProfileSampleKind::AsyncBegin) {
+            beginIndices[sample.m_asyncId] = sampleIndex;
+        } else if (sample.m_kind == ProfileSampleKind::AsyncEnd) {
+            auto it = beginIndices.find(sample.m_asyncId);
+            if (it != beginIndices.end()) {
+                ProfileAsyncSpan span;
+                span.m_begin = it->second;
+                span.m_end = sampleIndex;
+                spans.push_back(span);
+                beginIndices.erase(it);
+            }
+        }
+    }
+
+    return spans;
+}
+
+// Escape \p i_string for embedding within a JSON string literal.
+static std::string _EscapeJson(const std::string& i_string)
+{
+    std::string escaped;
+    escaped.reserve(i_string.size());
+    for (char character : i_string) {
+        switch (character) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            default:
+                if ((unsigned char)character < 0x20) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", character);
+                    escaped += code;
+                } else {
+                    escaped += character;
+                }
+        }
+    }
+
+    return escaped;
+}
+
+// Write \p i_nanoseconds as fractional microseconds, the time unit of the
+// Trace Event Format.
+static void _WriteMicroseconds(BufferedWriter& o_writer, uint64_t i_nanoseconds)
+{
+    uint64_t fraction = i_nanoseconds % 1000;
+    char decimals[4] = { '.',
+                         (char)('0' + fraction / 100),
+                         (char)('0' + (fraction / 10) % 10),
+                         (char)('0' + fraction % 10) };
+    o_writer.WriteUnsigned(i_nanoseconds / 1000);
+    o_writer.Write(decimals, sizeof(decimals));
+}
+
+void ProfileCapturePrint(const ProfileCapture& i_capture)
+{
+    std::vector<uint32_t> parentIndices = _FindParentRecords(i_capture);
+    std::vector<uint64_t> childTicks =
+        _ComputeChildTicks(i_capture, parentIndices);
+
+    bool corrected = i_capture.m_scopeOverheadNanoseconds > 0.0 ||
+                     i_capture.m_nestingOverheadNanoseconds > 0.0;
+    std::vector<uint64_t> correctedTicks;
+    std::vector<uint64_t> correctedChildTicks;
+    if (corrected) {
+        _ComputeCorrectedTicks(
+            i_capture, parentIndices, correctedTicks, correctedChildTicks);
+    }
+
+    printf("=== Profiler Timings ===\n");
+    for (uint32_t recordIndex = 0; recordIndex < i_capture.m_records.size();
+         ++recordIndex) {
+        const ProfileRecord& record = i_capture.m_records[recordIndex];
+        const ProfileCaptureSite& site = i_capture.m_sites[record.m_site];
+        uint64_t ticks = record.m_stop - record.m_start;
+        uint64_t nanoseconds = i_capture.TicksToNanoseconds(ticks);
+        uint64_t selfNanoseconds = i_capture.TicksToNanoseconds(
+            ticks > childTicks[recordIndex] ? ticks - childTicks[recordIndex]
+                                            : 0);
+
+        std::stringstream ss;
+        for (uint16_t stackIndex = 0; stackIndex < record.m_stack;
+             ++stackIndex) {
+            ss << " ";
+        }
+        ss << "\\_";
+
+        printf("%s User-string: '%s', file: %s, line: %u, thread: %u, stack: "
+               "%u, duration: %" PRIu64 " ns, self: %" PRIu64 " ns",
+               ss.str().c_str(),
+               site.m_name.c_str(),
+               site.m_file.c_str(),
+               site.m_line,
+               record.m_thread,
+               record.m_stack,
+               nanoseconds,
+               selfNanoseconds);
+        if (corrected) {
+            uint64_t recordTicks = correctedTicks[recordIndex];
+            uint64_t recordChildTicks = correctedChildTicks[recordIndex];
+            printf(", corrected: %" PRIu64 " ns, corrected self: %" PRIu64
+                   " ns",
+                   i_capture.TicksToNanoseconds(recordTicks),
+                   i_capture.TicksToNanoseconds(
+                       recordTicks > recordChildTicks
+                           ? recordTicks - recordChildTicks
+                           : 0));
+        }
+        printf("\n");
+    }
+}
+
+void ProfileCaptureSortRecords(ProfileCapture& io_capture)
+{
+    std::sort(io_capture.m_records.begin(),
+              io_capture.m_records.end(),
+              [](const ProfileRecord& a, const ProfileRecord& b) {
+                  // Enclosing records come first upon equal start ticks.
+                  if (a.m_start == b.m_start) {
+                      return a.m_stack < b.m_stack;
+                  } else {
+                      return a.m_start < b.m_start;
+                  }
+              });
+    std::stable_sort(io_capture.m_samples.begin(),
+                     io_capture.m_samples.end(),
+                     [](const ProfileSample& a, const ProfileSample& b) {
+                         return a.m_time < b.m_time;
+                     });
+}
+
+void ProfileCaptureAddMissingSites(ProfileCapture& io_capture)
+{
+    uint32_t siteCount = io_capture.m_sites.size();
+    for (const ProfileRecord& record : io_capture.m_records) {
+        siteCount = std::max(siteCount, record.m_site + 1);
+    }
+    for (const ProfileSample& sample : io_capture.m_samples) {
+        siteCount = std::max(siteCount, sample.m_site + 1);
+    }
+
+    while (io_capture.m_sites.size() < siteCount) {
+        ProfileCaptureSite site;
+        site.m_name = "site " + std::to_string(io_capture.m_sites.size());
+        io_capture.m_sites.push_back(site);
+    }
+    io_capture.m_siteStatistics.resize(io_capture.m_sites.size());
+}
+
+void ProfileCaptureComputeStatistics(ProfileCapture& io_capture)
+{
+    std::vector<uint32_t> parentIndices = _FindParentRecords(io_capture);
+    bool corrected = io_capture.m_scopeOverheadNanoseconds > 0.0 ||
+                     io_capture.m_nestingOverheadNanoseconds > 0.0;
+    std::vector<uint64_t> correctedTicks;
+    std::vector<uint64_t> childTicks;
+    if (corrected) {
+        _ComputeCorrectedTicks(
+            io_capture, parentIndices, correctedTicks, childTicks);
+    } else {
+        childTicks = _ComputeChildTicks(io_capture, parentIndices);
+    }
+
+    // Durations and self ticks of the records of each site.
+    std::vector<std::vector<uint64_t>> siteTicks(io_capture.m_sites.size());
+    std::vector<int64_t> siteSelfTicks(io_capture.m_sites.size(), 0);
+    for (uint32_t recordIndex = 0; recordIndex < io_capture.m_records.size();
+         ++recordIndex) {
+        const ProfileRecord& record = io_capture.m_records[recordIndex];
+        uint64_t ticks = corrected ? correctedTicks[recordIndex]
+                                   : record.m_stop - record.m_start;
+        siteTicks[record.m_site].push_back(ticks);
+        siteSelfTicks[record.m_site] +=
+            (int64_t)ticks - (int64_t)childTicks[recordIndex];
+    }
+
+    io_capture.m_siteStatistics.assign(io_capture.m_sites.size(),
+                                       ProfileSiteStatistics());
+    for (size_t siteIndex = 0; siteIndex < io_capture.m_sites.size();
+         ++siteIndex) {
+        std::vector<uint64_t>& ticks = siteTicks[siteIndex];
+        if (ticks.empty()) {
+            continue;
+        }
+
+        std::sort(ticks.begin(), ticks.end());
+        uint64_t totalTicks = 0;
+        double squaredTicks = 0.0;
+        for (uint64_t recordTicks : ticks) {
+            totalTicks += recordTicks;
+            squaredTicks += (double)recordTicks * recordTicks;
+        }
+
+        double count = (double)ticks.size();
+        double meanTicks = totalTicks / count;
+        double variance = std::max(squaredTicks / count - meanTicks * meanTicks,
+                                   0.0);
+        uint32_t sampleRate = io_capture.m_sites[siteIndex].m_sampleRate;
+        auto percentile = [&](double i_percentile) {
+            size_t rank = (size_t)std::ceil(i_percentile / 100.0 * count);
+            return io_capture.TicksToNanoseconds(
+                ticks[std::max<size_t>(rank, 1) - 1]);
+        };
+
+        ProfileSiteStatistics& statistics =
+            io_capture.m_siteStatistics[siteIndex];
+        statistics.m_count = ticks.size() * sampleRate;
+        statistics.m_totalNanoseconds =
+            io_capture.TicksToNanoseconds(totalTicks * sampleRate);
+        statistics.m_selfNanoseconds = io_capture.TicksToNanoseconds(
+            std::max<int64_t>(siteSelfTicks[siteIndex], 0) * sampleRate);
+        statistics.m_minNanoseconds = io_capture.TicksToNanoseconds(ticks[0]);
+        statistics.m_maxNanoseconds =
+            io_capture.TicksToNanoseconds(ticks.back());
+        statistics.m_meanNanoseconds =
+            meanTicks * io_capture.m_nanosecondsPerTick;
+        statistics.m_stddevNanoseconds =
+            std::sqrt(variance) * io_capture.m_nanosecondsPerTick;
+        statistics.m_p50Nanoseconds = percentile(50.0);
+        statistics.m_p90Nanoseconds = percentile(90.0);
+        statistics.m_p99Nanoseconds = percentile(99.0);
+        statistics.m_p999Nanoseconds = percentile(99.9);
+    }
+
+    // Counter totals are summed from the deltas of the remaining records.
+    if (io_capture.m_recordCounters.empty()) {
+        return;
+    }
+
+    std::unordered_map<uint64_t, uint32_t> recordSites;
+    recordSites.reserve(io_capture.m_records.size());
+    for (const ProfileRecord& record : io_capture.m_records) {
+        recordSites[((uint64_t)record.m_thread << 32) | record.m_id] =
+            record.m_site;
+    }
+    for (const ProfileRecordCounters& counters : io_capture.m_recordCounters) {
+        auto it = recordSites.find(((uint64_t)counters.m_thread << 32) |
+                                   counters.m_id);
+        if (it == recordSites.end()) {
+            continue;
+        }
+
+        ProfileSiteStatistics& statistics =
+            io_capture.m_siteStatistics[it->second];
+        uint32_t sampleRate = io_capture.m_sites[it->second].m_sampleRate;
+        for (uint32_t counterIndex = 0; counterIndex < c_maxProfileCounters;
+             ++counterIndex) {
+            statistics.m_counterTotals[counterIndex] +=
+                counters.m_values[counterIndex] * sampleRate;
+        }
+    }
+}
+
+void ProfileCapturePrintStatistics(const ProfileCapture& i_capture)
+{
+    std::vector<uint32_t> siteIndices;
+    for (uint32_t siteIndex = 0; siteIndex < i_capture.m_siteStatistics.size();
+         ++siteIndex) {
+        if (i_capture.m_siteStatistics[siteIndex].m_count > 0) {
+            siteIndices.push_back(siteIndex);
+        }
+    }
+
+    std::sort(siteIndices.begin(),
+              siteIndices.end(),
+              [&i_capture](uint32_t a, uint32_t b) {
+                  return i_capture.m_siteStatistics[a].m_totalNanoseconds >
+                         i_capture.m_siteStatistics[b].m_totalNanoseconds;
+              });
+
+    printf("=== Profiler Statistics ===\n");
+    if (i_capture.m_scopeOverheadNanoseconds > 0.0 ||
+        i_capture.m_nestingOverheadNanoseconds > 0.0) {
+        printf("Corrected for a profiler overhead of %.1f ns per region, and "
+               "%.1f ns per enclosed region, calibrated over %u regions.\n",
+               i_capture.m_scopeOverheadNanoseconds,
+               i_capture.m_nestingOverheadNanoseconds,
+               i_capture.m_calibrationRegionCount);
+    }
+    // Heap allocations are reported next to the timings of each site.
+    printf("%10s %14s %14s %12s %12s %12s %12s %12s %12s %12s %12s",
+           "Count",
+           "Total (ns)",
+           "Self (ns)",
+           "Mean (ns)",
+           "Min (ns)",
+           "Max (ns)",
+           "Stddev (ns)",
+           "p50 (ns)",
+           "p90 (ns)",
+           "p99 (ns)",
+           "p99.9 (ns)");
+    if (i_capture.m_allocations) {
+        printf(" %12s %14s %14s", "Allocations", "Bytes", "Peak live");
+    }
+    printf("  %s\n", "Site");
+    for (uint32_t siteIndex : siteIndices) {
+        const ProfileCaptureSite& site = i_capture.m_sites[siteIndex];
+        const ProfileSiteStatistics& statistics =
+            i_capture.m_siteStatistics[siteIndex];
+        printf("%10" PRIu64 " %14" PRIu64 " %14" PRIu64 " %12.1f %12" PRIu64
+               " %12" PRIu64 " %12.1f %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+               " %12" PRIu64,
+               statistics.m_count,
+               statistics.m_totalNanoseconds,
+               statistics.m_selfNanoseconds,
+               statistics.m_meanNanoseconds,
+               statistics.m_minNanoseconds,
+               statistics.m_maxNanoseconds,
+               statistics.m_stddevNanoseconds,
+               statistics.m_p50Nanoseconds,
+               statistics.m_p90Nanoseconds,
+               statistics.m_p99Nanoseconds,
+               statistics.m_p999Nanoseconds);
+        if (i_capture.m_allocations) {
+            printf(" %12" PRIu64 " %14" PRIu64 " %14" PRIu64,
+                   statistics.m_allocationCount,
+                   statistics.m_allocatedBytes,
+                   statistics.m_peakLiveBytes);
+        }
+        printf("  %s (%s:%u)",
+               site.m_name.c_str(),
+               site.m_file.c_str(),
+               site.m_line);
+        if (site.m_sampleRate > 1) {
+            printf(" [sampled 1/%u]", site.m_sampleRate);
+        }
+        if (site.m_throttled) {
+            printf(" [throttled]");
+        }
+        printf("\n");
+    }
+
+    // Off-CPU time is the share of wall time which the thread spent
+    // descheduled or blocked.
+    if (i_capture.m_cpuTime) {
+        printf("\n=== CPU Time ===\n");
+        printf("%10s %14s %14s %12s %12s %10s  %s\n",
+               "Count",
+               "Wall (ns)",
+               "CPU (ns)",
+               "Wall/call",
+               "CPU/call",
+               "Off-CPU %",
+               "Site");
+        for (uint32_t siteIndex : siteIndices) {
+            const ProfileCaptureSite& site = i_capture.m_sites[siteIndex];
+            const ProfileSiteStatistics& statistics =
+                i_capture.m_siteStatistics[siteIndex];
+            double wallNanoseconds = (double)statistics.m_totalNanoseconds;
+            double cpuNanoseconds = (double)statistics.m_cpuNanoseconds;
+            printf("%10" PRIu64 " %14" PRIu64 " %14" PRIu64
+                   " %12.1f %12.1f %10.1f  %s (%s:%u)\n",
+                   statistics.m_count,
+                   statistics.m_totalNanoseconds,
+                   statistics.m_cpuNanoseconds,
+                   wallNanoseconds / statistics.m_count,
+                   cpuNanoseconds / statistics.m_count,
+                   wallNanoseconds > 0.0
+                       ? 100.0 * (wallNanoseconds - cpuNanoseconds) /
+                             wallNanoseconds
+                       : 0.0,
+                   site.m_name.c_str(),
+                   site.m_file.c_str(),
+                   site.m_line);
+        }
+    }
+
+    // Performance counters are reported per call, along with the number of
+    // instructions per cycle when both are counted.
+    if (!i_capture.m_counterNames.empty()) {
+        const std::vector<std::string>& names = i_capture.m_counterNames;
+        size_t cyclesIndex =
+            std::find(names.begin(), names.end(), "cycles") - names.begin();
+        size_t instructionsIndex =
+            std::find(names.begin(), names.end(), "instructions") -
+            names.begin();
+        bool hasIpc =
+            cyclesIndex < names.size() && instructionsIndex < names.size();
+
+        printf("\n=== Counter Statistics (per call) ===\n");
+        printf("%10s", "Count");
+        for (const std::string& name : names) {
+            printf(" %16s", name.c_str());
+        }
+        if (hasIpc) {
+            printf(" %8s", "IPC");
+        }
+        printf("  %s\n", "Site");
+
+        for (uint32_t siteIndex : siteIndices) {
+            const ProfileCaptureSite& site = i_capture.m_sites[siteIndex];
+            const ProfileSiteStatistics& statistics =
+                i_capture.m_siteStatistics[siteIndex];
+            printf("%10" PRIu64, statistics.m_count);
+            for (size_t counterIndex = 0; counterIndex < names.size();
+                 ++counterIndex) {
+                printf(" %16.1f",
+                       (double)statistics.m_counterTotals[counterIndex] /
+                           statistics.m_count);
+            }
+            if (hasIpc) {
+                uint64_t cycles = statistics.m_counterTotals[cyclesIndex];
+                uint64_t instructions =
+                    statistics.m_counterTotals[instructionsIndex];
+                printf(" %8.2f",
+                       cycles > 0 ? (double)instructions / cycles : 0.0);
+            }
+            printf("  %s (%s:%u)\n",
+                   site.m_name.c_str(),
+                   site.m_file.c_str(),
+                   site.m_line);
+        }
+    }
+
+    // Tracks are summarized over the samples which are still recorded.
+    std::vector<uint64_t> sampleCounts(i_capture.m_sites.size(), 0);
+    std::vector<double> minValues(i_capture.m_sites.size(), 0.0);
+    std::vector<double> maxValues(i_capture.m_sites.size(), 0.0);
+    std::vector<double> lastValues(i_capture.m_sites.size(), 0.0);
+    bool hasTracks = false;
+    for (const ProfileSample& sample : i_capture.m_samples) {
+        if (sample.IsAsync()) {
+            continue;
+        }
+
+        double value = sample.GetValue();
+        double& minValue = minValues[sample.m_site];
+        double& maxValue = maxValues[sample.m_site];
+        if (sampleCounts[sample.m_site]++ == 0) {
+            minValue = value;
+            maxValue = value;
+        }
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+        lastValues[sample.m_site] = value;
+        hasTracks = true;
+    }
+
+    if (hasTracks) {
+        printf("\n=== Track Statistics ===\n");
+        printf("%10s %16s %16s %16s  %s\n",
+               "Samples",
+               "Min",
+               "Max",
+               "Last",
+               "Site");
+        for (uint32_t siteIndex = 0; siteIndex < i_capture.m_sites.size();
+             ++siteIndex) {
+            if (sampleCounts[siteIndex] == 0) {
+                continue;
+            }
+
+            const ProfileCaptureSite& site = i_capture.m_sites[siteIndex];
+            printf("%10" PRIu64 " %16g %16g %16g  %s (%s:%u)\n",
+                   sampleCounts[siteIndex],
+                   minValues[siteIndex],
+                   maxValues[siteIndex],
+                   lastValues[siteIndex],
+                   site.m_name.c_str(),
+                   site.m_file.c_str(),
+                   site.m_line);
+        }
+    }
+
+    // Asynchronous spans are summarized by the site of their beginning, and
+    // typically measure the latency of queues.
+    std::vector<ProfileAsyncSpan> spans = _MatchAsyncSpans(i_capture);
+    if (!spans.empty()) {
+        std::vector<uint64_t> spanCounts(i_capture.m_sites.size(), 0);
+        std::vector<uint64_t> crossThreadCounts(i_capture.m_sites.size(), 0);
+        std::vector<uint64_t> totalTicks(i_capture.m_sites.size(), 0);
+        std::vector<uint64_t> minTicks(i_capture.m_sites.size(), UINT64_MAX);
+        std::vector<uint64_t> maxTicks(i_capture.m_sites.size(), 0);
+        for (const ProfileAsyncSpan& span : spans) {
+            const ProfileSample& begin = i_capture.m_samples[span.m_begin];
+            const ProfileSample& end = i_capture.m_samples[span.m_end];
+            uint64_t ticks = end.m_time - begin.m_time;
+            ++spanCounts[begin.m_site];
+            if (begin.m_thread != end.m_thread) {
+                ++crossThreadCounts[begin.m_site];
+            }
+            totalTicks[begin.m_site] += ticks;
+            minTicks[begin.m_site] = std::min(minTicks[begin.m_site], ticks);
+            maxTicks[begin.m_site] = std::max(maxTicks[begin.m_site], ticks);
+        }
+
+        printf("\n=== Async Span Statistics ===\n");
+        printf("%10s %14s %12s %12s %12s %14s  %s\n",
+               "Count",
+               "Total (ns)",
+               "Mean (ns)",
+               "Min (ns)",
+               "Max (ns)",
+               "Cross-thread",
+               "Site");
+        for (uint32_t siteIndex = 0; siteIndex < i_capture.m_sites.size();
+             ++siteIndex) {
+            if (spanCounts[siteIndex] == 0) {
+                continue;
+            }
+
+            const ProfileCaptureSite& site = i_capture.m_sites[siteIndex];
+            uint64_t totalNanoseconds =
+                i_capture.TicksToNanoseconds(totalTicks[siteIndex]);
+            printf("%10" PRIu64 " %14" PRIu64 " %12.1f %12" PRIu64
+                   " %12" PRIu64 " %14" PRIu64 "  %s (%s:%u)\n",
+                   spanCounts[siteIndex],
+                   totalNanoseconds,
+                   (double)totalNanoseconds / spanCounts[siteIndex],
+                   i_capture.TicksToNanoseconds(minTicks[siteIndex]),
+                   i_capture.TicksToNanoseconds(maxTicks[siteIndex]),
+                   crossThreadCounts[siteIndex],
+                   site.m_name.c_str(),
+                   site.m_file.c_str(),
+                   site.m_line);
+        }
+    }
+
+    if (i_capture.m_droppedRecordCount > 0) {
+        printf("Dropped records: %" PRIu64 "\n",
+               i_capture.m_droppedRecordCount);
+    }
+}
+
+bool ProfileCaptureExportFoldedStacks(const ProfileCapture& i_capture,
+                                      const char* i_path)
+{
+    BufferedWriter writer;
+    if (!writer.Open(i_path)) {
+        return false;
+    }
+
+    const std::vector<ProfileRecord>& records = i_capture.m_records;
+    std::vector<uint32_t> parentIndices = _FindParentRecords(i_capture);
+    std::vector<uint64_t> childTicks =
+        _ComputeChildTicks(i_capture, parentIndices);
+
+    // Intern each unique stack as a (parent stack, site) pair, and resolve the
+    // stack of each record, enclosing records first.
+    std::vector<uint32_t> stackParents;
+    std::vector<uint32_t> stackSites;
+    std::unordered_map<uint64_t, uint32_t> stackIndices;
+    std::vector<uint32_t> recordStacks(records.size(), c_invalidIndex);
+    std::vector<uint32_t> unresolved;
+    for (uint32_t recordIndex = 0; recordIndex < records.size();
+         ++recordIndex) {
+        for (uint32_t index = recordIndex;
+             index != c_invalidIndex && recordStacks[index] == c_invalidIndex;
+             index = parentIndices[index]) {
+            unresolved.push_back(index);
+        }
+
+        while (!unresolved.empty()) {
+            uint32_t index = unresolved.back();
+            unresolved.pop_back();
+
+            uint32_t parentIndex = parentIndices[index];
+            uint32_t parentStack = parentIndex == c_invalidIndex
+                                       ? c_invalidIndex
+                                       : recordStacks[parentIndex];
+            uint32_t site = records[index].m_site;
+            auto it = stackIndices.emplace(
+                ((uint64_t)parentStack << 32) | site, stackParents.size());
+            if (it.second) {
+                stackParents.push_back(parentStack);
+                stackSites.push_back(site);
+            }
+            recordStacks[index] = it.first->second;
+        }
+    }
+
+    // Weigh each stack by the time exclusive to its innermost region.  The
+    // time exclusive to a single record may be negative, where enclosed
+    // records of sampled sites are over-estimated, so is only clamped once
+    // aggregated.
+    std::vector<int64_t> stackTicks(stackParents.size(), 0);
+    for (uint32_t recordIndex = 0; recordIndex < records.size();
+         ++recordIndex) {
+        const ProfileRecord& record = records[recordIndex];
+        int64_t selfTicks = (int64_t)(record.m_stop - record.m_start) -
+                            (int64_t)childTicks[recordIndex];
+        stackTicks[recordStacks[recordIndex]] +=
+            selfTicks * i_capture.m_sites[record.m_site].m_sampleRate;
+    }
+
+    // Semicolons delimit frames, and new lines delimit stacks.
+    std::vector<std::string> frameNames;
+    frameNames.reserve(i_capture.m_sites.size());
+    for (const ProfileCaptureSite& site : i_capture.m_sites) {
+        std::string frameName = site.m_name;
+        std::replace(frameName.begin(), frameName.end(), ';', ':');
+        std::replace(frameName.begin(), frameName.end(), '\n', ' ');
+        frameNames.push_back(frameName);
+    }
+
+    std::vector<uint32_t> frames;
+    for (uint32_t stackIndex = 0; stackIndex < stackParents.size();
+         ++stackIndex) {
+        if (stackTicks[stackIndex] <= 0) {
+            continue;
+        }
+
+        uint64_t nanoseconds =
+            i_capture.TicksToNanoseconds(stackTicks[stackIndex]);
+        if (nanoseconds == 0) {
+            continue;
+        }
+
+        frames.clear();
+        for (uint32_t index = stackIndex; index != c_invalidIndex;
+             index = stackParents[index]) {
+            frames.push_back(stackSites[index]);
+        }
+
+        for (size_t frameIndex = frames.size(); frameIndex-- > 0;) {
+            const std::string& frameName = frameNames[frames[frameIndex]];
+            writer.Write(frameName.data(), frameName.size());
+            writer.Write(frameIndex > 0 ? ";" : " ");
+        }
+        writer.WriteUnsigned(nanoseconds);
+        writer.Write("\n");
+    }
+
+    return writer.Close();
+}
+
+bool ProfileCaptureExportChromeTrace(const ProfileCapture& i_capture,
+                                     const char* i_path)
+{
+    BufferedWriter writer;
+    if (!writer.Open(i_path)) {
+        return false;
+    }
+
+    // The per-site portion of each event is escaped once up-front.
+    std::vector<std::string> siteFields;
+    siteFields.reserve(i_capture.m_sites.size());
+    for (const ProfileCaptureSite& site : i_capture.m_sites) {
+        std::stringstream ss;
+        ss << "{\"name\":\"" << _EscapeJson(site.m_name)
+           << "\",\"cat\":\"scope\",\"ph\":\"X\",\"pid\":0,\"args\":{\"file\":\""
+           << _EscapeJson(site.m_file) << "\",\"line\":" << site.m_line;
+        siteFields.push_back(ss.str());
+    }
+
+    // Performance counter deltas are added to the arguments of their record.
+    std::vector<std::string> counterFields;
+    for (const std::string& name : i_capture.m_counterNames) {
+        counterFields.push_back(",\"" + _EscapeJson(name) + "\":");
+    }
+
+    std::unordered_map<uint64_t, const ProfileRecordCounters*> recordCounters;
+    recordCounters.reserve(i_capture.m_recordCounters.size());
+    for (const ProfileRecordCounters& counters : i_capture.m_recordCounters) {
+        recordCounters[((uint64_t)counters.m_thread << 32) | counters.m_id] =
+            &counters;
+    }
+
+    // Timestamps are relative to the earliest record or sample.
+    uint64_t origin =
+        i_capture.m_records.empty() ? 0 : i_capture.m_records.front().m_start;
+    if (!i_capture.m_samples.empty() &&
+        (i_capture.m_records.empty() ||
+         i_capture.m_samples.front().m_time < origin)) {
+        origin = i_capture.m_samples.front().m_time;
+    }
+
+    writer.Write("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    uint32_t threadCount = 0;
+    for (const ProfileRecord& record : i_capture.m_records) {
+        const std::string& siteField = siteFields[record.m_site];
+        writer.Write(siteField.data(), siteField.size());
+        if (!recordCounters.empty()) {
+            auto it = recordCounters.find(((uint64_t)record.m_thread << 32) |
+                                          record.m_id);
+            if (it != recordCounters.end()) {
+                for (size_t counterIndex = 0;
+                     counterIndex < counterFields.size();
+                     ++counterIndex) {
+                    writer.Write(counterFields[counterIndex].c_str());
+                    writer.WriteUnsigned(it->second->m_values[counterIndex]);
+                }
+            }
+        }
+        writer.Write("},\"tid\":");
+        writer.WriteUnsigned(record.m_thread);
+        writer.Write(",\"ts\":");
+        _WriteMicroseconds(
+            writer, i_capture.TicksToNanoseconds(record.m_start - origin));
+        writer.Write(",\"dur\":");
+        _WriteMicroseconds(
+            writer, i_capture.TicksToNanoseconds(record.m_stop - record.m_start));
+        writer.Write("},\n");
+
+        if (record.m_thread >= threadCount) {
+            threadCount = record.m_thread + 1;
+        }
+    }
+
+    // Each site and thread has a counter track of its own, as the "id" tells
+    // the tracks of a name apart.  JSON cannot represent non-finite values.
+    std::vector<std::string> trackFields(i_capture.m_sites.size());
+    for (const ProfileSample& sample : i_capture.m_samples) {
+        double value = sample.GetValue();
+        if (sample.IsAsync() || !std::isfinite(value)) {
+            continue;
+        }
+
+        std::string& trackField = trackFields[sample.m_site];
+        if (trackField.empty()) {
+            trackField = "{\"name\":\"" +
+                         _EscapeJson(i_capture.m_sites[sample.m_site].m_name) +
+                         "\",\"cat\":\"track\",\"ph\":\"C\",\"pid\":0,\"tid\":";
+        }
+
+        char valueField[32];
+        snprintf(valueField, sizeof(valueField), "%.17g", value);
+        writer.Write(trackField.data(), trackField.size());
+        writer.WriteUnsigned(sample.m_thread);
+        writer.Write(",\"id\":");
+        writer.WriteUnsigned(sample.m_thread);
+        writer.Write(",\"ts\":");
+        _WriteMicroseconds(
+            writer, i_capture.TicksToNanoseconds(sample.m_time - origin));
+        writer.Write(",\"args\":{\"value\":");
+        writer.Write(valueField);
+        writer.Write("}},\n");
+
+        if (sample.m_thread >= threadCount) {
+            threadCount = sample.m_thread + 1;
+        }
+    }
+
+    // Asynchronous spans are drawn on tracks of their own, and linked by a
+    // flow arrow from the region enclosing their beginning to the region
+    // enclosing their end.  Both are named after the site of the beginning,
+    // as the events of a span must share their name.
+    for (const ProfileAsyncSpan& span : _MatchAsyncSpans(i_capture)) {
+        const ProfileSample& begin = i_capture.m_samples[span.m_begin];
+        const ProfileSample& end = i_capture.m_samples[span.m_end];
+        char idField[32];
+        snprintf(idField,
+                 sizeof(idField),
+                 "\"0x%" PRIx64 "\"",
+                 begin.m_asyncId);
+        std::string nameField =
+            "{\"name\":\"" +
+            _EscapeJson(i_capture.m_sites[begin.m_site].m_name) + "\"";
+
+        // Beginnings and ends alternate.
+        const char* phaseFields[] = {
+            ",\"cat\":\"async\",\"ph\":\"b\"",
+            ",\"cat\":\"async\",\"ph\":\"e\"",
+            ",\"cat\":\"flow\",\"ph\":\"s\"",
+            ",\"cat\":\"flow\",\"ph\":\"f\",\"bp\":\"e\""
+        };
+        for (uint32_t phaseIndex = 0; phaseIndex < 4; ++phaseIndex) {
+            const ProfileSample& sample = phaseIndex % 2 == 0 ? begin : end;
+            writer.Write(nameField.data(), nameField.size());
+            writer.Write(phaseFields[phaseIndex]);
+            writer.Write(",\"id\":");
+            writer.Write(idField);
+            writer.Write(",\"pid\":0,\"tid\":");
+            writer.WriteUnsigned(sample.m_thread);
+            writer.Write(",\"ts\":");
+            _WriteMicroseconds(
+                writer, i_capture.TicksToNanoseconds(sample.m_time - origin));
+            writer.Write("},\n");
+
+            if (sample.m_thread >= threadCount) {
+                threadCount = sample.m_thread + 1;
+            }
+        }
+    }
+
+    // Name the threads by their index, which also terminates the event array
+    // without a trailing comma.
+    for (uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        writer.Write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":");
+        writer.WriteUnsigned(threadIndex);
+        writer.Write(",\"args\":{\"name\":\"Thread ");
+        writer.WriteUnsigned(threadIndex);
+        writer.Write("\"}},\n");
+    }
+    writer.Write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                 "\"args\":{\"name\":\"euler\"}}\n],\n");
+
+    writer.Write("\"siteStatistics\":[");
+    const char* separator = "\n";
+    for (uint32_t siteIndex = 0; siteIndex < i_capture.m_siteStatistics.size();
+         ++siteIndex) {
+        const ProfileSiteStatistics& statistics =
+            i_capture.m_siteStatistics[siteIndex];
+        if (statistics.m_count == 0) {
+            continue;
+        }
+
+        const ProfileCaptureSite& site = i_capture.m_sites[siteIndex];
+        char moments[128];
+        snprintf(moments,
+                 sizeof(moments),
+                 ",\"meanNs\":%.1f,\"stddevNs\":%.1f",
+                 statistics.m_meanNanoseconds,
+                 statistics.m_stddevNanoseconds);
+
+        writer.Write(separator);
+        writer.Write("{\"name\":\"");
+        writer.Write(_EscapeJson(site.m_name).c_str());
+        writer.Write("\",\"file\":\"");
+        writer.Write(_EscapeJson(site.m_file).c_str());
+        writer.Write("\",\"line\":");
+        writer.WriteUnsigned(site.m_line);
+        writer.Write(",\"sampleRate\":");
+        writer.WriteUnsigned(site.m_sampleRate);
+        writer.Write(site.m_throttled ? ",\"throttled\":true"
+                                      : ",\"throttled\":false");
+        writer.Write(",\"count\":");
+        writer.WriteUnsigned(statistics.m_count);
+        writer.Write(",\"totalNs\":");
+        writer.WriteUnsigned(statistics.m_totalNanoseconds);
+        writer.Write(",\"selfNs\":");
+        writer.WriteUnsigned(statistics.m_selfNanoseconds);
+        writer.Write(",\"minNs\":");
+        writer.WriteUnsigned(statistics.m_minNanoseconds);
+        writer.Write(",\"maxNs\":");
+        writer.WriteUnsigned(statistics.m_maxNanoseconds);
+        writer.Write(moments);
+        writer.Write(",\"p50Ns\":");
+        writer.WriteUnsigned(statistics.m_p50Nanoseconds);
+        writer.Write(",\"p90Ns\":");
+        writer.WriteUnsigned(statistics.m_p90Nanoseconds);
+        writer.Write(",\"p99Ns\":");
+        writer.WriteUnsigned(statistics.m_p99Nanoseconds);
+        writer.Write(",\"p999Ns\":");
+        writer.WriteUnsigned(statistics.m_p999Nanoseconds);
+        if (i_capture.m_cpuTime) {
+            writer.Write(",\"cpuNs\":");
+            writer.WriteUnsigned(statistics.m_cpuNanoseconds);
+        }
+        if (i_capture.m_allocations) {
+            writer.Write(",\"allocationCount\":");
+            writer.WriteUnsigned(statistics.m_allocationCount);
+            writer.Write(",\"allocatedBytes\":");
+            writer.WriteUnsigned(statistics.m_allocatedBytes);
+            writer.Write(",\"peakLiveBytes\":");
+            writer.WriteUnsigned(statistics.m_peakLiveBytes);
+        }
+        if (!counterFields.empty()) {
+            writer.Write(",\"counterTotals\":{");
+            for (size_t counterIndex = 0; counterIndex < counterFields.size();
+                 ++counterIndex) {
+                // Skip the leading comma of the first counter.
+                writer.Write(counterFields[counterIndex].c_str() +
+                             (counterIndex == 0 ? 1 : 0));
+                writer.WriteUnsigned(statistics.m_counterTotals[counterIndex]);
+            }
+            writer.Write("}");
+        }
+        writer.Write("}");
+        separator = ",\n";
+    }
+    writer.Write("\n],\n\"droppedRecordCount\":");
+    writer.WriteUnsigned(i_capture.m_droppedRecordCount);
+    writer.Write("}\n");
+
+    return writer.Close();
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+/// \file profileCapture.h
+///
+/// Snapshot of profiled records, decoupled from the live record buffers, for
+/// consumption by reports and exporters.
+
+#include <euler/api.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// \class ProfileRecord
+///
+/// A single timed record of executed code.
+///
+/// Each region is identified by a per-thread sequence number, starting at 1,
+/// and refers to its enclosing region on the same thread by \ref m_parent
+/// (0 for outermost regions).
+///
+/// Records are kept compact, such that large captures stay resident in cache,
+/// and are authored in one go when the profiled region stops, such that each
+/// record only touches a single cache line.
+class alignas(32) ProfileRecord
+{
+public:
+    // Members.
+    uint64_t m_start = 0;  // 8 bytes
+    uint64_t m_stop = 0;   // 16 bytes
+    uint32_t m_site = 0;   // 20 bytes
+    uint16_t m_stack = 0;  // 22 bytes
+    uint16_t m_thread = 0; // 24 bytes
+    uint32_t m_id = 0;     // 28 bytes
+    uint32_t m_parent = 0; // 32 bytes
+};
+
+static_assert(sizeof(ProfileRecord) == 32,
+              "ProfileRecord must be 32 bytes in size");
+
+/// Maximum number of performance counters collected per profiled region.
+constexpr uint32_t c_maxProfileCounters = 4;
+
+/// \class ProfileRecordCounters
+///
+/// Performance counter deltas over a profiled region, which refer to its
+/// record by thread and identifier, as counters are only collected on demand.
+class ProfileRecordCounters
+{
+public:
+    uint16_t m_thread = 0;
+    uint32_t m_id = 0;
+    uint64_t m_values[c_maxProfileCounters] = {};
+};
+
+/// Kind of value tracked by a \ref ProfileSample.
+enum class ProfileSampleKind : uint8_t
+{
+    /// Integer value, such as a number of candidates tried.
+    Counter,
+
+    /// Floating-point value, such as a ratio.
+    Gauge,
+
+    /// Beginning of an asynchronous span.
+    AsyncBegin,
+
+    /// End of an asynchronous span, which may be on another thread than its
+    /// beginning.  Its site is unknown, so left as 0.
+    AsyncEnd
+};
+
+/// \class ProfileSample
+///
+/// A timestamped value of a counter or gauge track, which is named after its
+/// site, or either end of an asynchronous span, which are paired by their
+/// identifier.
+///
+/// Samples are timed in the ticks of the records, such that tracks line up
+/// with the regions of the timeline.
+class ProfileSample
+{
+public:
+    /// Is this either end of an asynchronous span?
+    bool IsAsync() const
+    {
+        return m_kind == ProfileSampleKind::AsyncBegin ||
+               m_kind == ProfileSampleKind::AsyncEnd;
+    }
+
+    /// Get the value of a track, converted to floating-point for counters.
+    double GetValue() const
+    {
+        return m_kind == ProfileSampleKind::Gauge ? m_gauge
+                                                  : (double)m_counter;
+    }
+
+    // Members.
+    uint64_t m_time = 0;
+    union
+    {
+        int64_t m_counter = 0;
+        double m_gauge;
+        uint64_t m_asyncId;
+    };
+    uint32_t m_site = 0;
+    uint16_t m_thread = 0;
+    ProfileSampleKind m_kind = ProfileSampleKind::Counter;
+};
+
+static_assert(sizeof(ProfileSample) == 24,
+              "ProfileSample must be 24 bytes in size");
+
+/// \class ProfileCaptureSite
+///
+/// Description of a profiled call site, owned by a capture.
+class ProfileCaptureSite
+{
+public:
+    std::string m_file;
+    uint32_t m_line = 0;
+    std::string m_name;
+
+    /// Only 1 in every \p m_sampleRate entries of the site were profiled.
+    uint32_t m_sampleRate = 1;
+
+    /// Did the site exceed the call rate limit, such that it stopped authoring
+    /// records for a while on at least one thread?
+    bool m_throttled = false;
+};
+
+/// \class ProfileSiteStatistics
+///
+/// Aggregate timings of all the profiled regions of a call site, including
+/// regions whose records have since been overwritten.
+///
+/// Total time is inclusive of enclosed profiled regions on the same thread,
+/// while self time excludes them.
+///
+/// Counts and totals of sampled sites are scaled up by the sampling rate.
+///
+/// Percentiles are read from a log-linear histogram, so are accurate to
+/// within ~3%.
+class ProfileSiteStatistics
+{
+public:
+    uint64_t m_count = 0;
+    uint64_t m_totalNanoseconds = 0;
+    uint64_t m_selfNanoseconds = 0;
+    uint64_t m_minNanoseconds = 0;
+    uint64_t m_maxNanoseconds = 0;
+    double m_meanNanoseconds = 0.0;
+    double m_stddevNanoseconds = 0.0;
+    uint64_t m_p50Nanoseconds = 0;
+    uint64_t m_p90Nanoseconds = 0;
+    uint64_t m_p99Nanoseconds = 0;
+    uint64_t m_p999Nanoseconds = 0;
+
+    /// CPU time spent by the thread over all regions, inclusive of enclosed
+    /// regions, if \ref ProfileCapture::m_cpuTime is set.
+    uint64_t m_cpuNanoseconds = 0;
+
+    /// Heap allocations made directly within the regions, excluding enclosed
+    /// regions, if \ref ProfileCapture::m_allocations is set.
+    uint64_t m_allocationCount = 0;
+    uint64_t m_allocatedBytes = 0;
+
+    /// Largest increase of the live heap bytes of the thread over any region,
+    /// including enclosed regions.
+    uint64_t m_peakLiveBytes = 0;
+
+    /// Totals of the performance counters named by
+    /// \ref ProfileCapture::m_counterNames, if any, inclusive of enclosed
+    /// regions.
+    uint64_t m_counterTotals[c_maxProfileCounters] = {};
+};
+
+/// \class ProfileCapture
+///
+/// Profiled records along with the metadata required to interpret them.
+class ProfileCapture
+{
+public:
+    /// Convert a duration in ticks of the captured clock into nanoseconds.
+    uint64_t TicksToNanoseconds(uint64_t i_ticks) const
+    {
+        return (uint64_t)((double)i_ticks * m_nanosecondsPerTick);
+    }
+
+    /// Conversion factor from record ticks to nanoseconds.
+    double m_nanosecondsPerTick = 1.0;
+
+    /// Call sites, indexed by \ref ProfileRecord::m_site.
+    std::vector<ProfileCaptureSite> m_sites;
+
+    /// Statistics of each call site, indexed like \ref m_sites.
+    std::vector<ProfileSiteStatistics> m_siteStatistics;
+
+    /// Records of all the threads, ordered by start tick.
+    std::vector<ProfileRecord> m_records;
+
+    /// Number of records which were dropped, rather than streamed to disk,
+    /// as the drain of a continuous capture fell behind.
+    uint64_t m_droppedRecordCount = 0;
+
+    /// Copies of the records of \ref m_records whose regions never closed,
+    /// as the profiled process crashed, outermost first.
+    std::vector<ProfileRecord> m_openRecords;
+
+    /// Was the CPU time of each region measured?
+    bool m_cpuTime = false;
+
+    /// Were heap allocations attributed to regions?
+    bool m_allocations = false;
+
+    /// Names of the performance counters which were collected, if any.
+    std::vector<std::string> m_counterNames;
+
+    /// Calibrated overhead of the profiler which falls between the timestamps
+    /// of each region, and which falls within the enclosing region of each
+    /// region, or 0 if not calibrated.
+    ///
+    /// The site statistics already exclude this overhead, unlike the records.
+    double m_scopeOverheadNanoseconds = 0.0;
+    double m_nestingOverheadNanoseconds = 0.0;
+
+    /// Number of empty regions of the last round of the calibration, of which
+    /// \ref m_scopeOverheadNanoseconds is the median, or 0 if not calibrated.
+    uint32_t m_calibrationRegionCount = 0;
+
+    /// Performance counter deltas of the records of \ref m_records, in no
+    /// particular order.
+    std::vector<ProfileRecordCounters> m_recordCounters;
+
+    /// Samples of the counter and gauge tracks, and ends of the asynchronous
+    /// spans, of all the threads, ordered by time.
+    std::vector<ProfileSample> m_samples;
+};
+
+/// Snapshot the records of the profiler set up by \ref ProfilerSetup into
+/// \p o_capture.  Sessions are captured by \ref ProfilerSession::Capture.
+///
+/// \return false if the profiler has not been set up.
+EULER_API
+bool ProfilerCapture(ProfileCapture& o_capture);
+
+/// Order the records of \p io_capture by start tick, enclosing records first,
+/// and its samples by time.
+EULER_API
+void ProfileCaptureSortRecords(ProfileCapture& io_capture);
+
+/// Add placeholder sites, named after their identifier, for the sites which
+/// are referenced by the records of \p io_capture but missing from its site
+/// table.
+EULER_API
+void ProfileCaptureAddMissingSites(ProfileCapture& io_capture);
+
+/// Derive the statistics of each site of \p io_capture from its records,
+/// for captures whose statistics were not preserved or no longer apply.
+///
+/// Unlike live statistics, only the regions which are still recorded are
+/// accounted for, and percentiles are exact.  Durations are corrected for
+/// the calibrated overhead, if any, and counter totals are summed from
+/// \ref ProfileCapture::m_recordCounters.  CPU time and allocations are not
+/// recorded per region, so they are left at 0.
+EULER_API
+void ProfileCaptureComputeStatistics(ProfileCapture& io_capture);
+
+/// Pretty-print the records of \p i_capture in a human-readable form.
+///
+/// The self time of each record excludes the enclosed records which are still
+/// present in the capture.  If the overhead of the profiler was calibrated,
+/// durations corrected for the overhead within each record and its enclosed
+/// records are printed as well.
+EULER_API
+void ProfileCapturePrint(const ProfileCapture& i_capture);
+
+/// Pretty-print the statistics of each call site of \p i_capture, ordered by
+/// descending total time, followed by their CPU time, heap allocations and
+/// performance counters per call, if measured, by the range of each counter
+/// and gauge track which was sampled, and by the latencies of the
+/// asynchronous spans of each site.
+EULER_API
+void ProfileCapturePrintStatistics(const ProfileCapture& i_capture);
+
+/// Write the records of \p i_capture to \p i_path in Brendan Gregg's folded
+/// stack format, one line per unique stack, weighted by the nanoseconds spent
+/// in the innermost region of the stack.
+///
+/// Threads are merged.  Regions whose enclosing region is no longer recorded
+/// are treated as outermost.  Weights of sampled sites are scaled up by the
+/// sampling rate.
+///
+/// \return false if the file could not be written.
+EULER_API
+bool ProfileCaptureExportFoldedStacks(const ProfileCapture& i_capture,
+                                      const char* i_path);
+
+/// Write the records of \p i_capture to \p i_path in the Chrome Trace Event
+/// Format, as complete ("X") events.
+///
+/// The statistics of each call site are written under an additional top-level
+/// "siteStatistics" key, which trace viewers ignore.  Performance counter
+/// deltas, if any, are written as arguments of their event.  Samples are
+/// written as counter ("C") events, on a track per site and thread.
+/// Asynchronous spans are written as nestable async ("b" and "e") events,
+/// along with a flow arrow from the region enclosing their beginning to the
+/// region enclosing their end.
+///
+/// \return false if the file could not be written.
+EULER_API
+bool ProfileCaptureExportChromeTrace(const ProfileCapture& i_capture,
+                                     const char* i_path);
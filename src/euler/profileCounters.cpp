@@ -0,0 +1,138 @@
+#include "profileCounters.h"
+
+#include <string.h>
+
+#if defined(__linux__)
+#    define EULER_PROFILER_HAS_PERF_EVENTS 1
+#    include <errno.h>
+#    include <linux/perf_event.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#else
+#    define EULER_PROFILER_HAS_PERF_EVENTS 0
+#endif
+
+ProfileCounterGroup::~ProfileCounterGroup()
+{
+    Close();
+}
+
+void ProfileCounterGroup::GetNames(ProfileCounterSet i_set,
+                                   std::vector<std::string>& o_names)
+{
+    if (i_set == ProfileCounterSet::Hardware) {
+        o_names = { "cycles", "instructions", "branch-misses", "LLC-misses" };
+    } else {
+        o_names = {
+            "task-clock", "page-faults", "context-switches", "cpu-migrations"
+        };
+    }
+}
+
+#if EULER_PROFILER_HAS_PERF_EVENTS
+
+bool ProfileCounterGroup::Open(ProfileCounterSet i_set)
+{
+    Close();
+
+    struct Event
+    {
+        uint32_t m_type;
+        uint64_t m_config;
+    };
+    static const Event c_hardwareEvents[c_maxProfileCounters] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE,
+          PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    static const Event c_softwareEvents[c_maxProfileCounters] = {
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+    };
+    const Event* events = i_set == ProfileCounterSet::Hardware
+                              ? c_hardwareEvents
+                              : c_softwareEvents;
+
+    for (uint32_t eventIndex = 0; eventIndex < c_maxProfileCounters;
+         ++eventIndex) {
+        struct perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = events[eventIndex].m_type;
+        attributes.config = events[eventIndex].m_config;
+        attributes.read_format = PERF_FORMAT_GROUP;
+
+        // Unprivileged processes may only count user space on the PMU.
+        attributes.exclude_kernel = i_set == ProfileCounterSet::Hardware;
+        attributes.exclude_hv = 1;
+
+        int groupFile = m_fileCount > 0 ? m_files[0] : -1;
+        int file = (int)syscall(
+            SYS_perf_event_open, &attributes, 0, -1, groupFile, 0);
+
+        // Counting the kernel is denied to unprivileged processes for any
+        // event type, under the default perf_event_paranoid of 2, in which
+        // case software events are counted in user space only.
+        if (file < 0 && (errno == EACCES || errno == EPERM) &&
+            !attributes.exclude_kernel) {
+            attributes.exclude_kernel = 1;
+            file = (int)syscall(
+                SYS_perf_event_open, &attributes, 0, -1, groupFile, 0);
+        }
+        if (file < 0) {
+            if (m_fileCount == 0) {
+                return false;
+            }
+            continue;
+        }
+
+        m_files[m_fileCount] = file;
+        m_valueIndices[m_fileCount] = eventIndex;
+        ++m_fileCount;
+    }
+
+    return true;
+}
+
+void ProfileCounterGroup::Read(uint64_t* o_values) const
+{
+    // The group is read as the number of counters, followed by their values.
+    uint64_t values[1 + c_maxProfileCounters] = {};
+    if (m_fileCount > 0 && read(m_files[0], values, sizeof(values)) > 0) {
+        for (uint32_t fileIndex = 0;
+             fileIndex < m_fileCount && fileIndex < values[0];
+             ++fileIndex) {
+            o_values[m_valueIndices[fileIndex]] = values[1 + fileIndex];
+        }
+    }
+}
+
+void ProfileCounterGroup::Close()
+{
+    // Members are closed before the leader of the group.
+    while (m_fileCount > 0) {
+        close(m_files[--m_fileCount]);
+    }
+}
+
+#else
+
+bool ProfileCounterGroup::Open(ProfileCounterSet /* i_set */)
+{
+    return false;
+}
+
+void ProfileCounterGroup::Read(uint64_t* /* o_values */) const
+{
+}
+
+void ProfileCounterGroup::Close()
+{
+}
+
+#endif
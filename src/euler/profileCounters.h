@@ -0,0 +1,74 @@
+#pragma once
+
+/// \file profileCounters.h
+///
+/// Performance counters of the profiled threads, read at the boundaries of
+/// each profiled region.
+
+#include <euler/api.h>
+#include <euler/profileCapture.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// \enum ProfileCounterSet
+///
+/// Sets of performance counters.
+enum class ProfileCounterSet
+{
+    /// Cycles, instructions, branch misses and last-level cache load misses,
+    /// counted by the performance monitoring unit in user space.
+    Hardware,
+
+    /// Task clock, page faults, context switches and CPU migrations, counted
+    /// by the kernel, for virtual machines which do not expose a PMU.
+    ///
+    /// Unprivileged processes only count these in user space, where
+    /// context switches do not occur and thus count as 0.
+    Software
+};
+
+/// \class ProfileCounterGroup
+///
+/// A group of performance counters of the calling thread, opened with
+/// perf_event_open(2) such that all its counters are scheduled together and
+/// read in a single system call.
+///
+/// Counters which the system does not support are left out of the group, and
+/// read as 0.  Only supported on Linux.
+class EULER_API ProfileCounterGroup final
+{
+public:
+    ProfileCounterGroup() = default;
+    ~ProfileCounterGroup();
+
+    // Cannot be copied.
+    ProfileCounterGroup(const ProfileCounterGroup& i_group) = delete;
+    ProfileCounterGroup& operator=(const ProfileCounterGroup& i_group) = delete;
+
+    /// Open the counters of \p i_set for the calling thread.
+    ///
+    /// \return false if not even the first counter of the set is available.
+    bool Open(ProfileCounterSet i_set);
+
+    /// Read the current values of the counters into \p o_values, of
+    /// \ref c_maxProfileCounters entries.  Values of the counters which are
+    /// not open, or cannot be read, are left unchanged.
+    void Read(uint64_t* o_values) const;
+
+    /// Get the names of the counters of \p i_set, in order of their values.
+    static void GetNames(ProfileCounterSet i_set,
+                         std::vector<std::string>& o_names);
+
+private:
+    /// Close all the counters.
+    void Close();
+
+    /// Descriptors of the open counters, the first of which leads the group.
+    int m_files[c_maxProfileCounters];
+    uint32_t m_fileCount = 0;
+
+    /// Index of the value of each open counter.
+    uint32_t m_valueIndices[c_maxProfileCounters];
+};
@@ -0,0 +1,384 @@
+#include "profileMapping.h"
+
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define EULER_PROFILER_HAS_MMAP 1
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#else
+#    define EULER_PROFILER_HAS_MMAP 0
+#endif
+
+/// Leading bytes of every mapping file.
+static const char c_mappingMagic[8] = {
+    'E', 'U', 'L', 'E', 'R', 'M', 'A', 'P'
+};
+
+/// Version of the layout of mapping files.
+///
+/// Version 2 extends the frames with the overhead of their enclosed regions.
+constexpr uint32_t c_mappingVersion = 2;
+
+/// Size of the header, which is a multiple of any page size.
+constexpr size_t c_headerSize = 1 << 16;
+
+/// Size of the site table arena, which is a multiple of any page size.
+constexpr size_t c_siteArenaSize = 1 << 20;
+
+/// Size of the header of each thread slot, which keeps the records aligned.
+constexpr size_t c_slotHeaderSize = 64;
+
+/// \class ProfileMappingHeader
+///
+/// Leading bytes of a mapping file.
+class ProfileMappingHeader final
+{
+public:
+    char m_magic[8];
+    uint32_t m_version = c_mappingVersion;
+    uint32_t m_recordCapacity = 0;
+    double m_nanosecondsPerTick = 1.0;
+    uint64_t m_slotSize = 0;
+
+    /// Published once the corresponding site or thread slot is written.
+    std::atomic<uint32_t> m_siteCount{ 0 };
+    std::atomic<uint32_t> m_threadCount{ 0 };
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "Mapped counters must be laid out as plain integers");
+
+/// \class ProfileMappingSite
+///
+/// Entry of the site table, followed by the characters of the file and name.
+class ProfileMappingSite final
+{
+public:
+    uint32_t m_line = 0;
+    uint32_t m_sampleRate = 1;
+    uint32_t m_fileSize = 0;
+    uint32_t m_nameSize = 0;
+};
+
+/// \class ProfileMappingSlot
+///
+/// Leading bytes of the slot of a thread, followed by its frames and records.
+class ProfileMappingSlot final
+{
+public:
+    uint32_t m_threadIndex = 0;
+};
+
+static_assert(sizeof(ProfileMappingSlot) <= c_slotHeaderSize,
+              "ProfileMappingSlot must fit in the slot header");
+
+// Get the offset of the records within a thread slot.
+static constexpr size_t _GetSlotRecordsOffset()
+{
+    return c_slotHeaderSize + c_maxStackDepth * sizeof(ProfileFrame);
+}
+
+ProfileMapping::~ProfileMapping()
+{
+    Close();
+}
+
+#if EULER_PROFILER_HAS_MMAP
+
+bool ProfileMapping::Open(const char* i_path,
+                          uint32_t i_recordCapacity,
+                          double i_nanosecondsPerTick)
+{
+    Close();
+
+    m_file = open(i_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_file < 0) {
+        return false;
+    }
+
+    void* header = MAP_FAILED;
+    if (ftruncate(m_file, c_headerSize + c_siteArenaSize) == 0) {
+        header = mmap(nullptr,
+                      c_headerSize + c_siteArenaSize,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED,
+                      m_file,
+                      0);
+    }
+    if (header == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    // Slots are aligned to pages, so that each can be mapped on its own.
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t slotSize = _GetSlotRecordsOffset() +
+                      (size_t)i_recordCapacity * sizeof(ProfileRecord);
+    m_slotSize = (slotSize + pageSize - 1) / pageSize * pageSize;
+    m_recordCapacity = i_recordCapacity;
+    m_siteOffset = 0;
+
+    m_header = (char*)header;
+    ProfileMappingHeader* mappingHeader = new (m_header) ProfileMappingHeader();
+    mappingHeader->m_recordCapacity = i_recordCapacity;
+    mappingHeader->m_nanosecondsPerTick = i_nanosecondsPerTick;
+    mappingHeader->m_slotSize = m_slotSize;
+
+    // The magic is written last, such that partial files are not recognized.
+    memcpy(mappingHeader->m_magic, c_mappingMagic, sizeof(c_mappingMagic));
+    return true;
+}
+
+void ProfileMapping::AddSite(const char* i_file,
+                             uint32_t i_line,
+                             const char* i_name,
+                             uint32_t i_sampleRate)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_header == nullptr) {
+        return;
+    }
+
+    // Once a site does not fit, neither do the following ones, so that the
+    // identifiers of the named sites remain their index in the table.
+    ProfileMappingSite site;
+    site.m_line = i_line;
+    site.m_sampleRate = i_sampleRate;
+    site.m_fileSize = strlen(i_file);
+    site.m_nameSize = strlen(i_name);
+    size_t siteSize = sizeof(site) + site.m_fileSize + site.m_nameSize;
+    if (m_siteOffset + siteSize > c_siteArenaSize) {
+        m_siteOffset = c_siteArenaSize;
+        return;
+    }
+
+    char* entry = m_header + c_headerSize + m_siteOffset;
+    memcpy(entry, &site, sizeof(site));
+    memcpy(entry + sizeof(site), i_file, site.m_fileSize);
+    memcpy(entry + sizeof(site) + site.m_fileSize, i_name, site.m_nameSize);
+    m_siteOffset += siteSize;
+
+    ProfileMappingHeader* header = (ProfileMappingHeader*)m_header;
+    header->m_siteCount.fetch_add(1, std::memory_order_release);
+}
+
+bool ProfileMapping::MapThread(ProfileFrame*& o_frames,
+                               ProfileRecord*& o_records)
+{
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_header == nullptr) {
+        return false;
+    }
+
+    size_t offset =
+        c_headerSize + c_siteArenaSize + m_slots.size() * m_slotSize;
+    if (ftruncate(m_file, offset + m_slotSize) != 0) {
+        return false;
+    }
+
+    void* slot = mmap(nullptr,
+                      m_slotSize,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED,
+                      m_file,
+                      offset);
+    if (slot == MAP_FAILED) {
+        return false;
+    }
+
+    ProfileMappingSlot* slotHeader = new (slot) ProfileMappingSlot();
+    slotHeader->m_threadIndex = m_slots.size();
+    m_slots.push_back(slot);
+
+    // The file is zero-filled, which marks every frame and record as unused.
+    o_frames = (ProfileFrame*)((char*)slot + c_slotHeaderSize);
+    o_records = (ProfileRecord*)((char*)slot + _GetSlotRecordsOffset());
+
+    ProfileMappingHeader* header = (ProfileMappingHeader*)m_header;
+    header->m_threadCount.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+size_t ProfileMapping::GetMappedSize() const
+{
+    if (m_header == nullptr) {
+        return 0;
+    }
+
+    return c_headerSize + c_siteArenaSize + m_slots.size() * m_slotSize;
+}
+
+void ProfileMapping::Close()
+{
+    for (void* slot : m_slots) {
+        munmap(slot, m_slotSize);
+    }
+    m_slots.clear();
+
+    if (m_header != nullptr) {
+        munmap(m_header, c_headerSize + c_siteArenaSize);
+        m_header = nullptr;
+    }
+
+    if (m_file >= 0) {
+        close(m_file);
+        m_file = -1;
+    }
+}
+
+#else
+
+bool ProfileMapping::Open(const char* i_path,
+                          uint32_t i_recordCapacity,
+                          double i_nanosecondsPerTick)
+{
+    return false;
+}
+
+void ProfileMapping::AddSite(const char* i_file,
+                             uint32_t i_line,
+                             const char* i_name,
+                             uint32_t i_sampleRate)
+{
+}
+
+bool ProfileMapping::MapThread(ProfileFrame*& o_frames,
+                               ProfileRecord*& o_records)
+{
+    return false;
+}
+
+size_t ProfileMapping::GetMappedSize() const
+{
+    return 0;
+}
+
+void ProfileMapping::Close()
+{
+}
+
+#endif
+
+bool ProfileMappingRead(const char* i_path, ProfileCapture& o_capture)
+{
+    o_capture = ProfileCapture();
+
+    FILE* file = fopen(i_path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    std::vector<char> bytes;
+    char chunk[1 << 16];
+    size_t chunkSize = 0;
+    while ((chunkSize = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        bytes.insert(bytes.end(), chunk, chunk + chunkSize);
+    }
+    fclose(file);
+
+    ProfileMappingHeader header;
+    if (bytes.size() < c_headerSize + c_siteArenaSize) {
+        return false;
+    }
+    memcpy((void*)&header, bytes.data(), sizeof(header));
+    if (memcmp(header.m_magic, c_mappingMagic, sizeof(c_mappingMagic)) != 0 ||
+        header.m_version != c_mappingVersion ||
+        header.m_slotSize <
+            _GetSlotRecordsOffset() +
+                (uint64_t)header.m_recordCapacity * sizeof(ProfileRecord)) {
+        return false;
+    }
+    o_capture.m_nanosecondsPerTick = header.m_nanosecondsPerTick;
+
+    // Sites.
+    uint32_t siteCount = header.m_siteCount.load(std::memory_order_relaxed);
+    size_t siteOffset = c_headerSize;
+    for (uint32_t siteIndex = 0; siteIndex < siteCount; ++siteIndex) {
+        ProfileMappingSite site;
+        if (siteOffset + sizeof(site) > c_headerSize + c_siteArenaSize) {
+            break;
+        }
+        memcpy(&site, bytes.data() + siteOffset, sizeof(site));
+        siteOffset += sizeof(site);
+        if (siteOffset + site.m_fileSize + site.m_nameSize >
+            c_headerSize + c_siteArenaSize) {
+            break;
+        }
+
+        ProfileCaptureSite captureSite;
+        captureSite.m_line = site.m_line;
+        captureSite.m_sampleRate = site.m_sampleRate;
+        captureSite.m_file.assign(bytes.data() + siteOffset, site.m_fileSize);
+        siteOffset += site.m_fileSize;
+        captureSite.m_name.assign(bytes.data() + siteOffset, site.m_nameSize);
+        siteOffset += site.m_nameSize;
+        o_capture.m_sites.push_back(captureSite);
+    }
+
+    // Records, and the frames of the regions which were still open.
+    uint64_t lastTick = 0;
+    uint32_t threadCount = header.m_threadCount.load(std::memory_order_relaxed);
+    for (uint32_t threadIndex = 0; threadIndex < threadCount; ++threadIndex) {
+        size_t slotOffset =
+            c_headerSize + c_siteArenaSize + threadIndex * header.m_slotSize;
+        if (slotOffset + header.m_slotSize > bytes.size()) {
+            break;
+        }
+
+        const char* slot = bytes.data() + slotOffset;
+        for (uint32_t recordIndex = 0; recordIndex < header.m_recordCapacity;
+             ++recordIndex) {
+            ProfileRecord record;
+            memcpy(&record,
+                   slot + _GetSlotRecordsOffset() +
+                       recordIndex * sizeof(ProfileRecord),
+                   sizeof(record));
+
+            // Unused records are zero, and the record being authored when
+            // the process crashed may be torn.
+            if (record.m_id == 0 || record.m_stop < record.m_start ||
+                record.m_thread != threadIndex) {
+                continue;
+            }
+            o_capture.m_records.push_back(record);
+            lastTick = std::max(lastTick, record.m_stop);
+        }
+
+        uint32_t parent = 0;
+        for (uint16_t stack = 0; stack < c_maxStackDepth; ++stack) {
+            ProfileFrame frame;
+            memcpy(&frame,
+                   slot + c_slotHeaderSize + stack * sizeof(ProfileFrame),
+                   sizeof(frame));
+            if (frame.m_id == 0) {
+                break;
+            }
+
+            ProfileRecord record;
+            record.m_start = frame.m_start;
+            record.m_site = frame.m_site;
+            record.m_stack = stack;
+            record.m_thread = threadIndex;
+            record.m_id = frame.m_id;
+            record.m_parent = parent;
+            o_capture.m_openRecords.push_back(record);
+            lastTick = std::max(lastTick, frame.m_start);
+            parent = frame.m_id;
+        }
+    }
+
+    for (ProfileRecord& record : o_capture.m_openRecords) {
+        record.m_stop = lastTick;
+        o_capture.m_records.push_back(record);
+    }
+
+    ProfileCaptureAddMissingSites(o_capture);
+    ProfileCaptureSortRecords(o_capture);
+    ProfileCaptureComputeStatistics(o_capture);
+    return true;
+}
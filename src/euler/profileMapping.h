@@ -0,0 +1,128 @@
+#pragma once
+
+/// \file profileMapping.h
+///
+/// Record storage backed by a shared file mapping, which the operating system
+/// preserves when the profiled process crashes, for post-mortem analysis.
+
+#include <euler/api.h>
+#include <euler/profileCapture.h>
+
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Maximum number of nested regions profiled per thread.  Regions nested any
+/// deeper are not recorded.
+constexpr uint16_t c_maxStackDepth = 256;
+
+/// \class ProfileFrame
+///
+/// A profiled region which is currently open on a thread.
+///
+/// The identifier of a frame is reset to 0 once its region closes, such that
+/// the regions which were open when a process crashed can be told apart.
+class ProfileFrame final
+{
+public:
+    uint64_t m_start = 0;
+    uint32_t m_site = 0;
+    uint32_t m_id = 0;
+
+    /// Time spent in the directly enclosed regions which have closed so far,
+    /// scaled by their sampling rates.
+    uint64_t m_childTicks = 0;
+
+    /// Sampling rate of the site.
+    uint32_t m_sampleRate = 1;
+
+    /// Calibrated profiler overhead incurred by the enclosed regions which
+    /// have closed so far, which is excluded from the duration of the region.
+    uint64_t m_overheadTicks = 0;
+};
+
+/// \class ProfileMapping
+///
+/// A file shared-mapped into memory, holding the site table along with the
+/// open frames and the record ring of each profiled thread.
+///
+/// The file is laid out as a header page, followed by a fixed-size arena for
+/// the site table, followed by one slot per thread, which is appended upon
+/// registration of the thread.  Threads author their frames and records into
+/// their slot with plain stores, which the operating system writes back to
+/// the file even if the process crashes.
+///
+/// Mappings are only supported on POSIX systems.
+class EULER_API ProfileMapping final
+{
+public:
+    ProfileMapping() = default;
+    ~ProfileMapping();
+
+    // Cannot be copied.
+    ProfileMapping(const ProfileMapping& i_mapping) = delete;
+    ProfileMapping& operator=(const ProfileMapping& i_mapping) = delete;
+
+    /// Create the file at \p i_path, truncating any existing content, for
+    /// threads of \p i_recordCapacity records timed in ticks of
+    /// \p i_nanosecondsPerTick nanoseconds.
+    ///
+    /// \return false if the file could not be created and mapped.
+    bool Open(const char* i_path,
+              uint32_t i_recordCapacity,
+              double i_nanosecondsPerTick);
+
+    /// Append a site to the site table.  Sites must be added in order of
+    /// their identifiers.  Sites which do not fit in the arena are left
+    /// unnamed.
+    void AddSite(const char* i_file,
+                 uint32_t i_line,
+                 const char* i_name,
+                 uint32_t i_sampleRate);
+
+    /// Map the slot of a new thread.
+    ///
+    /// \param o_frames receives the open frames of the thread, of
+    /// \ref c_maxStackDepth entries.
+    /// \param o_records receives the record ring of the thread.
+    ///
+    /// \return false if the file could not be extended.
+    bool MapThread(ProfileFrame*& o_frames, ProfileRecord*& o_records);
+
+    /// Get the number of bytes of the file mapped into memory.
+    size_t GetMappedSize() const;
+
+private:
+    /// Unmap everything and close the file.
+    void Close();
+
+    int m_file = -1;
+    uint32_t m_recordCapacity = 0;
+    size_t m_slotSize = 0;
+
+    /// Guards the site table and the registration of threads.
+    std::mutex m_mutex;
+
+    /// Mapped header page and site arena.
+    char* m_header = nullptr;
+
+    /// Offset of the next site in the site arena.
+    size_t m_siteOffset = 0;
+
+    /// Mapped thread slots.
+    std::vector<void*> m_slots;
+};
+
+/// Read the records of the mapping file at \p i_path into \p o_capture, as
+/// left by a process which may have crashed.
+///
+/// Regions which were still open are closed at the last tick observed in the
+/// file, and also listed in \ref ProfileCapture::m_openRecords.  The
+/// statistics of each site are derived from the records.
+///
+/// \return false if the file could not be read, or is not a mapping file of
+/// a supported version.
+EULER_API
+bool ProfileMappingRead(const char* i_path, ProfileCapture& o_capture);
@@ -0,0 +1,883 @@
+#include "profileTrace.h"
+#include "profileMapping.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define EULER_PROFILER_HAS_WRITE 1
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#else
+#    define EULER_PROFILER_HAS_WRITE 0
+#endif
+
+/// Leading bytes of every trace file.
+static const char c_traceMagic[8] = { 'E', 'U', 'L', 'E', 'R', 'T', 'R', 'C' };
+
+// Build the tag of a block from its four characters.
+constexpr uint32_t _Tag(char a, char b, char c, char d)
+{
+    return (uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) |
+           ((uint32_t)d << 24);
+}
+
+/// Block tags.
+constexpr uint32_t c_recordsTag = _Tag('R', 'E', 'C', 'S');
+constexpr uint32_t c_sitesTag = _Tag('S', 'I', 'T', 'E');
+constexpr uint32_t c_statisticsTag = _Tag('S', 'T', 'A', 'T');
+constexpr uint32_t c_siteUsageTag = _Tag('U', 'S', 'A', 'G');
+constexpr uint32_t c_measurementsTag = _Tag('M', 'E', 'A', 'S');
+constexpr uint32_t c_droppedTag = _Tag('D', 'R', 'O', 'P');
+constexpr uint32_t c_openRecordsTag = _Tag('O', 'P', 'E', 'N');
+constexpr uint32_t c_samplesTag = _Tag('S', 'M', 'P', 'L');
+constexpr uint32_t c_endTag = _Tag('E', 'N', 'D', ' ');
+
+// Append the bytes of \p i_value to \p o_bytes.
+template <typename T>
+static void _Append(std::vector<char>& o_bytes, const T& i_value)
+{
+    const char* bytes = (const char*)&i_value;
+    o_bytes.insert(o_bytes.end(), bytes, bytes + sizeof(T));
+}
+
+/// Maximum size of a variable-length integer.
+constexpr size_t c_maxVarintSize = 10;
+
+/// Maximum size of a packed record.
+constexpr size_t c_maxPackedRecordSize = 6 * c_maxVarintSize;
+
+/// Maximum size of a packed sample.
+constexpr size_t c_maxPackedSampleSize = 3 * c_maxVarintSize;
+
+// Write \p i_value at \p io_cursor as a variable-length integer, 7 bits per
+// byte, least significant first, and advance \p io_cursor past it.
+static inline void _PackVarint(char*& io_cursor, uint64_t i_value)
+{
+    while (i_value >= 0x80) {
+        *io_cursor++ = (char)(i_value | 0x80);
+        i_value >>= 7;
+    }
+    *io_cursor++ = (char)i_value;
+}
+
+// Map signed \p i_value to an unsigned integer, such that values of small
+// magnitude remain small.
+static uint64_t _ZigZag(int64_t i_value)
+{
+    return ((uint64_t)i_value << 1) ^ (uint64_t)(i_value >> 63);
+}
+
+// Invert _ZigZag().
+static int64_t _UnZigZag(uint64_t i_value)
+{
+    return (int64_t)(i_value >> 1) ^ -(int64_t)(i_value & 1);
+}
+
+// Append the size and characters of \p i_string to \p o_bytes.
+static void _AppendString(std::vector<char>& o_bytes,
+                          const std::string& i_string)
+{
+    _Append(o_bytes, (uint32_t)i_string.size());
+    o_bytes.insert(o_bytes.end(), i_string.begin(), i_string.end());
+}
+
+/// \class TracePayloadReader
+///
+/// Reads values from the payload of a block, failing once past its end.
+class TracePayloadReader final
+{
+public:
+    explicit TracePayloadReader(const std::vector<char>& i_payload)
+      : m_payload(i_payload)
+    {
+    }
+
+    /// Read the next value into \p o_value.
+    template <typename T>
+    bool Read(T& o_value)
+    {
+        if (m_offset + sizeof(T) > m_payload.size()) {
+            return false;
+        }
+
+        memcpy(&o_value, m_payload.data() + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    /// Read the next variable-length integer into \p o_value.
+    bool ReadVarint(uint64_t& o_value)
+    {
+        o_value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7) {
+            if (m_offset == m_payload.size()) {
+                return false;
+            }
+
+            uint8_t byte = (uint8_t)m_payload[m_offset++];
+            o_value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Read the next sized string into \p o_string.
+    bool ReadString(std::string& o_string)
+    {
+        uint32_t size = 0;
+        if (!Read(size) || m_offset + size > m_payload.size()) {
+            return false;
+        }
+
+        o_string.assign(m_payload.data() + m_offset, size);
+        m_offset += size;
+        return true;
+    }
+
+    /// Get the number of bytes left to read.
+    size_t GetRemainingSize() const { return m_payload.size() - m_offset; }
+
+private:
+    const std::vector<char>& m_payload;
+    size_t m_offset = 0;
+};
+
+// Pack the header of a block of \p i_recordCount records of the thread at
+// \p i_threadIndex at \p io_cursor, followed by the records, and advance
+// \p io_cursor past them.
+static void _PackRecords(char*& io_cursor,
+                         uint16_t i_threadIndex,
+                         const ProfileRecord* i_records,
+                         uint32_t i_recordCount)
+{
+    _PackVarint(io_cursor, i_threadIndex);
+    _PackVarint(io_cursor, i_recordCount);
+
+    uint64_t previousStart = 0;
+    uint32_t previousId = 0;
+    for (uint32_t recordIndex = 0; recordIndex < i_recordCount;
+         ++recordIndex) {
+        const ProfileRecord& record = i_records[recordIndex];
+        _PackVarint(io_cursor,
+                    _ZigZag((int64_t)(record.m_start - previousStart)));
+        _PackVarint(io_cursor, record.m_stop - record.m_start);
+        _PackVarint(io_cursor, record.m_site);
+        _PackVarint(io_cursor, record.m_stack);
+        _PackVarint(io_cursor, _ZigZag((int64_t)record.m_id - previousId));
+        _PackVarint(io_cursor,
+                    record.m_parent != 0 ? record.m_id - record.m_parent : 0);
+        previousStart = record.m_start;
+        previousId = record.m_id;
+    }
+}
+
+// Pack the header of a block of \p i_sampleCount samples of the thread at
+// \p i_threadIndex at \p io_cursor, followed by the samples, and advance
+// \p io_cursor past them.
+//
+// Times are encoded relative to the previous sample of the block, and the
+// kind of each sample in the lowest two bits of its site.  Gauges are stored
+// verbatim.
+static void _PackSamples(char*& io_cursor,
+                         uint16_t i_threadIndex,
+                         const ProfileSample* i_samples,
+                         uint32_t i_sampleCount)
+{
+    _PackVarint(io_cursor, i_threadIndex);
+    _PackVarint(io_cursor, i_sampleCount);
+
+    uint64_t previousTime = 0;
+    for (uint32_t sampleIndex = 0; sampleIndex < i_sampleCount;
+         ++sampleIndex) {
+        const ProfileSample& sample = i_samples[sampleIndex];
+        _PackVarint(io_cursor,
+                    _ZigZag((int64_t)(sample.m_time - previousTime)));
+        _PackVarint(io_cursor,
+                    ((uint64_t)sample.m_site << 2) | (uint64_t)sample.m_kind);
+        if (sample.m_kind == ProfileSampleKind::Counter) {
+            _PackVarint(io_cursor, _ZigZag(sample.m_counter));
+        } else if (sample.m_kind == ProfileSampleKind::Gauge) {
+            memcpy(io_cursor, &sample.m_gauge, sizeof(sample.m_gauge));
+            io_cursor += sizeof(sample.m_gauge);
+        } else {
+            _PackVarint(io_cursor, sample.m_asyncId);
+        }
+        previousTime = sample.m_time;
+    }
+}
+
+bool ProfileTraceWriter::Open(const char* i_path, double i_nanosecondsPerTick)
+{
+    if (!m_writer.Open(i_path)) {
+        return false;
+    }
+
+    m_writer.Write(c_traceMagic, sizeof(c_traceMagic));
+    m_writer.Write(&c_profileTraceVersion, sizeof(c_profileTraceVersion));
+    m_writer.Write(&i_nanosecondsPerTick, sizeof(i_nanosecondsPerTick));
+    return true;
+}
+
+void ProfileTraceWriter::WriteRecords(uint16_t i_threadIndex,
+                                      const ProfileRecord* i_records,
+                                      uint32_t i_recordCount)
+{
+    // Records are packed through a cursor into a payload of the worst-case
+    // size, which is trimmed afterwards.
+    m_payload.resize(2 * c_maxVarintSize +
+                     (size_t)i_recordCount * c_maxPackedRecordSize);
+    char* cursor = m_payload.data();
+    _PackRecords(cursor, i_threadIndex, i_records, i_recordCount);
+    m_payload.resize(cursor - m_payload.data());
+    WriteBlock(c_recordsTag);
+}
+
+void ProfileTraceWriter::WriteSamples(uint16_t i_threadIndex,
+                                      const ProfileSample* i_samples,
+                                      uint32_t i_sampleCount)
+{
+    m_payload.resize(2 * c_maxVarintSize +
+                     (size_t)i_sampleCount * c_maxPackedSampleSize);
+    char* cursor = m_payload.data();
+    _PackSamples(cursor, i_threadIndex, i_samples, i_sampleCount);
+    m_payload.resize(cursor - m_payload.data());
+    WriteBlock(c_samplesTag);
+}
+
+void ProfileTraceWriter::WriteSummary(const ProfileCapture& i_summary)
+{
+    m_payload.clear();
+    _Append(m_payload, (uint32_t)i_summary.m_sites.size());
+    for (const ProfileCaptureSite& site : i_summary.m_sites) {
+        _Append(m_payload, site.m_line);
+        _Append(m_payload, site.m_sampleRate);
+        _Append(m_payload, (uint8_t)site.m_throttled);
+        _AppendString(m_payload, site.m_file);
+        _AppendString(m_payload, site.m_name);
+    }
+    WriteBlock(c_sitesTag);
+
+    m_payload.clear();
+    _Append(m_payload, (uint32_t)i_summary.m_siteStatistics.size());
+    for (const ProfileSiteStatistics& statistics : i_summary.m_siteStatistics) {
+        _Append(m_payload, statistics.m_count);
+        _Append(m_payload, statistics.m_totalNanoseconds);
+        _Append(m_payload, statistics.m_selfNanoseconds);
+        _Append(m_payload, statistics.m_minNanoseconds);
+        _Append(m_payload, statistics.m_maxNanoseconds);
+        _Append(m_payload, statistics.m_meanNanoseconds);
+        _Append(m_payload, statistics.m_stddevNanoseconds);
+        _Append(m_payload, statistics.m_p50Nanoseconds);
+        _Append(m_payload, statistics.m_p90Nanoseconds);
+        _Append(m_payload, statistics.m_p99Nanoseconds);
+        _Append(m_payload, statistics.m_p999Nanoseconds);
+    }
+    WriteBlock(c_statisticsTag);
+
+    m_payload.clear();
+    _Append(m_payload, (uint32_t)i_summary.m_siteStatistics.size());
+    _Append(m_payload, (uint32_t)c_maxProfileCounters);
+    for (const ProfileSiteStatistics& statistics : i_summary.m_siteStatistics) {
+        _Append(m_payload, statistics.m_cpuNanoseconds);
+        _Append(m_payload, statistics.m_allocationCount);
+        _Append(m_payload, statistics.m_allocatedBytes);
+        _Append(m_payload, statistics.m_peakLiveBytes);
+        for (uint64_t counterTotal : statistics.m_counterTotals) {
+            _Append(m_payload, counterTotal);
+        }
+    }
+    WriteBlock(c_siteUsageTag);
+
+    m_payload.clear();
+    _Append(m_payload, (uint8_t)i_summary.m_cpuTime);
+    _Append(m_payload, (uint8_t)i_summary.m_allocations);
+    _Append(m_payload, i_summary.m_scopeOverheadNanoseconds);
+    _Append(m_payload, i_summary.m_nestingOverheadNanoseconds);
+    _Append(m_payload, i_summary.m_calibrationRegionCount);
+    _Append(m_payload, (uint32_t)i_summary.m_counterNames.size());
+    for (const std::string& name : i_summary.m_counterNames) {
+        _AppendString(m_payload, name);
+    }
+    WriteBlock(c_measurementsTag);
+
+    m_payload.clear();
+    _Append(m_payload, i_summary.m_droppedRecordCount);
+    WriteBlock(c_droppedTag);
+}
+
+bool ProfileTraceWriter::Close()
+{
+    m_payload.clear();
+    WriteBlock(c_endTag);
+    return m_writer.Close();
+}
+
+void ProfileTraceWriter::WriteBlock(uint32_t i_tag)
+{
+    uint64_t size = m_payload.size();
+    m_writer.Write(&i_tag, sizeof(i_tag));
+    m_writer.Write(&size, sizeof(size));
+    m_writer.Write(m_payload.data(), m_payload.size());
+}
+
+#if EULER_PROFILER_HAS_WRITE
+
+bool ProfileTraceSignalWriter::Open(const char* i_path,
+                                    double i_nanosecondsPerTick)
+{
+    m_file = open(i_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_file < 0) {
+        return false;
+    }
+
+    WriteBytes(c_traceMagic, sizeof(c_traceMagic));
+    WriteBytes(&c_profileTraceVersion, sizeof(c_profileTraceVersion));
+    WriteBytes(&i_nanosecondsPerTick, sizeof(i_nanosecondsPerTick));
+    return true;
+}
+
+void ProfileTraceSignalWriter::WriteSite(const char* i_file,
+                                         uint32_t i_line,
+                                         const char* i_name,
+                                         uint32_t i_sampleRate)
+{
+    uint32_t siteCount = 1;
+    uint8_t throttled = 0;
+    uint32_t fileSize = strlen(i_file);
+    uint32_t nameSize = strlen(i_name);
+    uint64_t size = sizeof(siteCount) + sizeof(i_line) + sizeof(i_sampleRate) +
+                    sizeof(throttled) + sizeof(fileSize) + fileSize +
+                    sizeof(nameSize) + nameSize;
+    WriteBytes(&c_sitesTag, sizeof(c_sitesTag));
+    WriteBytes(&size, sizeof(size));
+    WriteBytes(&siteCount, sizeof(siteCount));
+    WriteBytes(&i_line, sizeof(i_line));
+    WriteBytes(&i_sampleRate, sizeof(i_sampleRate));
+    WriteBytes(&throttled, sizeof(throttled));
+    WriteBytes(&fileSize, sizeof(fileSize));
+    WriteBytes(i_file, fileSize);
+    WriteBytes(&nameSize, sizeof(nameSize));
+    WriteBytes(i_name, nameSize);
+}
+
+void ProfileTraceSignalWriter::WriteDroppedRecordCount(uint64_t i_count)
+{
+    uint64_t size = sizeof(i_count);
+    WriteBytes(&c_droppedTag, sizeof(c_droppedTag));
+    WriteBytes(&size, sizeof(size));
+    WriteBytes(&i_count, sizeof(i_count));
+}
+
+void ProfileTraceSignalWriter::WriteRecords(uint16_t i_threadIndex,
+                                            const ProfileRecord* i_records,
+                                            uint32_t i_recordCount)
+{
+    WritePackedRecords(c_recordsTag, i_threadIndex, i_records, i_recordCount);
+}
+
+void ProfileTraceSignalWriter::WriteOpenRecords(uint16_t i_threadIndex,
+                                                const ProfileRecord* i_records,
+                                                uint32_t i_recordCount)
+{
+    WritePackedRecords(
+        c_openRecordsTag, i_threadIndex, i_records, i_recordCount);
+}
+
+void ProfileTraceSignalWriter::WriteSamples(uint16_t i_threadIndex,
+                                            const ProfileSample* i_samples,
+                                            uint32_t i_sampleCount)
+{
+    static_assert(sizeof(m_payload) >= 2 * c_maxVarintSize +
+                                           c_blockRecordCount *
+                                               c_maxPackedSampleSize,
+                  "The payload must fit a block of samples");
+
+    do {
+        uint32_t blockSampleCount =
+            std::min<uint32_t>(i_sampleCount, c_blockRecordCount);
+        char* cursor = m_payload;
+        _PackSamples(cursor, i_threadIndex, i_samples, blockSampleCount);
+
+        uint64_t size = cursor - m_payload;
+        WriteBytes(&c_samplesTag, sizeof(c_samplesTag));
+        WriteBytes(&size, sizeof(size));
+        WriteBytes(m_payload, size);
+        i_samples += blockSampleCount;
+        i_sampleCount -= blockSampleCount;
+    } while (i_sampleCount > 0);
+}
+
+void ProfileTraceSignalWriter::Close()
+{
+    if (m_file < 0) {
+        return;
+    }
+
+    uint64_t size = 0;
+    WriteBytes(&c_endTag, sizeof(c_endTag));
+    WriteBytes(&size, sizeof(size));
+    close(m_file);
+    m_file = -1;
+}
+
+void ProfileTraceSignalWriter::WritePackedRecords(
+    uint32_t i_tag,
+    uint16_t i_threadIndex,
+    const ProfileRecord* i_records,
+    uint32_t i_recordCount)
+{
+    static_assert(sizeof(m_payload) >= 2 * c_maxVarintSize +
+                                           c_blockRecordCount *
+                                               c_maxPackedRecordSize,
+                  "The payload must fit a block of records");
+
+    // Records are written in blocks which fit the payload, as nothing may be
+    // allocated.
+    do {
+        uint32_t blockRecordCount =
+            std::min<uint32_t>(i_recordCount, c_blockRecordCount);
+        char* cursor = m_payload;
+        _PackRecords(cursor, i_threadIndex, i_records, blockRecordCount);
+
+        uint64_t size = cursor - m_payload;
+        WriteBytes(&i_tag, sizeof(i_tag));
+        WriteBytes(&size, sizeof(size));
+        WriteBytes(m_payload, size);
+        i_records += blockRecordCount;
+        i_recordCount -= blockRecordCount;
+    } while (i_recordCount > 0);
+}
+
+void ProfileTraceSignalWriter::WriteBytes(const void* i_bytes, size_t i_size)
+{
+    const char* bytes = (const char*)i_bytes;
+    while (m_file >= 0 && i_size > 0) {
+        ssize_t writtenSize = write(m_file, bytes, i_size);
+        if (writtenSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // Give up on the file, keeping what has been written so far.
+            close(m_file);
+            m_file = -1;
+            return;
+        }
+
+        bytes += writtenSize;
+        i_size -= writtenSize;
+    }
+}
+
+#else
+
+bool ProfileTraceSignalWriter::Open(const char* i_path,
+                                    double i_nanosecondsPerTick)
+{
+    return false;
+}
+
+void ProfileTraceSignalWriter::WriteSite(const char* i_file,
+                                         uint32_t i_line,
+                                         const char* i_name,
+                                         uint32_t i_sampleRate)
+{
+}
+
+void ProfileTraceSignalWriter::WriteDroppedRecordCount(uint64_t i_count)
+{
+}
+
+void ProfileTraceSignalWriter::WriteRecords(uint16_t i_threadIndex,
+                                            const ProfileRecord* i_records,
+                                            uint32_t i_recordCount)
+{
+}
+
+void ProfileTraceSignalWriter::WriteOpenRecords(uint16_t i_threadIndex,
+                                                const ProfileRecord* i_records,
+                                                uint32_t i_recordCount)
+{
+}
+
+void ProfileTraceSignalWriter::WriteSamples(uint16_t i_threadIndex,
+                                            const ProfileSample* i_samples,
+                                            uint32_t i_sampleCount)
+{
+}
+
+void ProfileTraceSignalWriter::Close()
+{
+}
+
+void ProfileTraceSignalWriter::WritePackedRecords(
+    uint32_t i_tag,
+    uint16_t i_threadIndex,
+    const ProfileRecord* i_records,
+    uint32_t i_recordCount)
+{
+}
+
+void ProfileTraceSignalWriter::WriteBytes(const void* i_bytes, size_t i_size)
+{
+}
+
+#endif
+
+bool ProfileCaptureExportTrace(const ProfileCapture& i_capture,
+                               const char* i_path)
+{
+    ProfileTraceWriter writer;
+    if (!writer.Open(i_path, i_capture.m_nanosecondsPerTick)) {
+        return false;
+    }
+
+    writer.WriteSummary(i_capture);
+
+    // Group the records by thread, preserving their order.
+    std::vector<ProfileRecord> records = i_capture.m_records;
+    std::stable_sort(records.begin(),
+                     records.end(),
+                     [](const ProfileRecord& a, const ProfileRecord& b) {
+                         return a.m_thread < b.m_thread;
+                     });
+
+    // Blocks are bounded in size, so that readers need little memory.
+    constexpr size_t c_blockRecordCount = 1 << 16;
+    size_t blockBegin = 0;
+    while (blockBegin < records.size()) {
+        uint16_t threadIndex = records[blockBegin].m_thread;
+        size_t blockEnd = blockBegin + 1;
+        while (blockEnd < records.size() &&
+               blockEnd - blockBegin < c_blockRecordCount &&
+               records[blockEnd].m_thread == threadIndex) {
+            ++blockEnd;
+        }
+
+        writer.WriteRecords(
+            threadIndex, &records[blockBegin], blockEnd - blockBegin);
+        blockBegin = blockEnd;
+    }
+
+    // Samples are grouped alike.
+    std::vector<ProfileSample> samples = i_capture.m_samples;
+    std::stable_sort(samples.begin(),
+                     samples.end(),
+                     [](const ProfileSample& a, const ProfileSample& b) {
+                         return a.m_thread < b.m_thread;
+                     });
+
+    blockBegin = 0;
+    while (blockBegin < samples.size()) {
+        uint16_t threadIndex = samples[blockBegin].m_thread;
+        size_t blockEnd = blockBegin + 1;
+        while (blockEnd < samples.size() &&
+               blockEnd - blockBegin < c_blockRecordCount &&
+               samples[blockEnd].m_thread == threadIndex) {
+            ++blockEnd;
+        }
+
+        writer.WriteSamples(
+            threadIndex, &samples[blockBegin], blockEnd - blockBegin);
+        blockBegin = blockEnd;
+    }
+
+    return writer.Close();
+}
+
+// Parse the payload of a block of packed records into \p io_records.
+static bool _ReadPackedRecords(TracePayloadReader& io_reader,
+                               std::vector<ProfileRecord>& io_records)
+{
+    uint64_t threadIndex = 0;
+    uint64_t recordCount = 0;
+    if (!io_reader.ReadVarint(threadIndex) ||
+        !io_reader.ReadVarint(recordCount)) {
+        return false;
+    }
+
+    ProfileRecord record;
+    record.m_thread = (uint16_t)threadIndex;
+    for (uint64_t recordIndex = 0; recordIndex < recordCount; ++recordIndex) {
+        uint64_t start = 0;
+        uint64_t duration = 0;
+        uint64_t site = 0;
+        uint64_t stack = 0;
+        uint64_t id = 0;
+        uint64_t parent = 0;
+        if (!io_reader.ReadVarint(start) || !io_reader.ReadVarint(duration) ||
+            !io_reader.ReadVarint(site) || !io_reader.ReadVarint(stack) ||
+            !io_reader.ReadVarint(id) || !io_reader.ReadVarint(parent)) {
+            return false;
+        }
+
+        record.m_start += _UnZigZag(start);
+        record.m_stop = record.m_start + duration;
+        record.m_site = (uint32_t)site;
+        record.m_stack = (uint16_t)stack;
+        record.m_id += (uint32_t)_UnZigZag(id);
+        record.m_parent = parent != 0 ? record.m_id - (uint32_t)parent : 0;
+        io_records.push_back(record);
+    }
+
+    return true;
+}
+
+// Parse the payload of a block of packed samples into \p io_samples.
+static bool _ReadPackedSamples(TracePayloadReader& io_reader,
+                               std::vector<ProfileSample>& io_samples)
+{
+    uint64_t threadIndex = 0;
+    uint64_t sampleCount = 0;
+    if (!io_reader.ReadVarint(threadIndex) ||
+        !io_reader.ReadVarint(sampleCount)) {
+        return false;
+    }
+
+    ProfileSample sample;
+    sample.m_thread = (uint16_t)threadIndex;
+    for (uint64_t sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex) {
+        uint64_t time = 0;
+        uint64_t site = 0;
+        if (!io_reader.ReadVarint(time) || !io_reader.ReadVarint(site)) {
+            return false;
+        }
+
+        sample.m_time += _UnZigZag(time);
+        sample.m_site = (uint32_t)(site >> 2);
+        sample.m_kind = (ProfileSampleKind)(site & 3);
+        if (sample.m_kind == ProfileSampleKind::Counter) {
+            uint64_t counter = 0;
+            if (!io_reader.ReadVarint(counter)) {
+                return false;
+            }
+            sample.m_counter = _UnZigZag(counter);
+        } else if (sample.m_kind == ProfileSampleKind::Gauge) {
+            if (!io_reader.Read(sample.m_gauge)) {
+                return false;
+            }
+        } else if (!io_reader.ReadVarint(sample.m_asyncId)) {
+            return false;
+        }
+        io_samples.push_back(sample);
+    }
+
+    return true;
+}
+
+// Parse the payload of a block tagged \p i_tag into \p io_capture.
+static bool _ReadBlock(uint32_t i_tag,
+                       const std::vector<char>& i_payload,
+                       ProfileCapture& io_capture)
+{
+    TracePayloadReader reader(i_payload);
+    if (i_tag == c_recordsTag) {
+        return _ReadPackedRecords(reader, io_capture.m_records);
+    } else if (i_tag == c_openRecordsTag) {
+        return _ReadPackedRecords(reader, io_capture.m_openRecords);
+    } else if (i_tag == c_samplesTag) {
+        return _ReadPackedSamples(reader, io_capture.m_samples);
+    } else if (i_tag == c_sitesTag) {
+        // Each site takes at least its fixed-size fields and the sizes of its
+        // strings, which bounds the count of a damaged block.
+        constexpr size_t c_minSiteSize =
+            4 * sizeof(uint32_t) + sizeof(uint8_t);
+        uint32_t siteCount = 0;
+        if (!reader.Read(siteCount) ||
+            siteCount > reader.GetRemainingSize() / c_minSiteSize) {
+            return false;
+        }
+
+        // Sites may be split across several blocks.
+        size_t firstSite = io_capture.m_sites.size();
+        io_capture.m_sites.resize(firstSite + siteCount);
+        for (size_t siteIndex = firstSite;
+             siteIndex < io_capture.m_sites.size();
+             ++siteIndex) {
+            ProfileCaptureSite& site = io_capture.m_sites[siteIndex];
+            uint8_t throttled = 0;
+            if (!reader.Read(site.m_line) || !reader.Read(site.m_sampleRate) ||
+                !reader.Read(throttled) || !reader.ReadString(site.m_file) ||
+                !reader.ReadString(site.m_name)) {
+                return false;
+            }
+            site.m_throttled = throttled != 0;
+        }
+    } else if (i_tag == c_statisticsTag) {
+        constexpr size_t c_statisticsSize =
+            9 * sizeof(uint64_t) + 2 * sizeof(double);
+        uint32_t siteCount = 0;
+        if (!reader.Read(siteCount) ||
+            siteCount > reader.GetRemainingSize() / c_statisticsSize) {
+            return false;
+        }
+
+        io_capture.m_siteStatistics.resize(siteCount);
+        for (ProfileSiteStatistics& statistics : io_capture.m_siteStatistics) {
+            if (!reader.Read(statistics.m_count) ||
+                !reader.Read(statistics.m_totalNanoseconds) ||
+                !reader.Read(statistics.m_selfNanoseconds) ||
+                !reader.Read(statistics.m_minNanoseconds) ||
+                !reader.Read(statistics.m_maxNanoseconds) ||
+                !reader.Read(statistics.m_meanNanoseconds) ||
+                !reader.Read(statistics.m_stddevNanoseconds) ||
+                !reader.Read(statistics.m_p50Nanoseconds) ||
+                !reader.Read(statistics.m_p90Nanoseconds) ||
+                !reader.Read(statistics.m_p99Nanoseconds) ||
+                !reader.Read(statistics.m_p999Nanoseconds)) {
+                return false;
+            }
+        }
+    } else if (i_tag == c_siteUsageTag) {
+        // Counters beyond those known to the reader are skipped.
+        uint32_t siteCount = 0;
+        uint32_t counterCount = 0;
+        if (!reader.Read(siteCount) || !reader.Read(counterCount) ||
+            siteCount > reader.GetRemainingSize() /
+                            ((4 + (uint64_t)counterCount) * sizeof(uint64_t))) {
+            return false;
+        }
+
+        io_capture.m_siteStatistics.resize(siteCount);
+        for (ProfileSiteStatistics& statistics : io_capture.m_siteStatistics) {
+            if (!reader.Read(statistics.m_cpuNanoseconds) ||
+                !reader.Read(statistics.m_allocationCount) ||
+                !reader.Read(statistics.m_allocatedBytes) ||
+                !reader.Read(statistics.m_peakLiveBytes)) {
+                return false;
+            }
+
+            for (uint32_t counterIndex = 0; counterIndex < counterCount;
+                 ++counterIndex) {
+                uint64_t counterTotal = 0;
+                if (!reader.Read(counterTotal)) {
+                    return false;
+                }
+                if (counterIndex < c_maxProfileCounters) {
+                    statistics.m_counterTotals[counterIndex] = counterTotal;
+                }
+            }
+        }
+    } else if (i_tag == c_measurementsTag) {
+        uint8_t cpuTime = 0;
+        uint8_t allocations = 0;
+        uint32_t counterCount = 0;
+        if (!reader.Read(cpuTime) || !reader.Read(allocations) ||
+            !reader.Read(io_capture.m_scopeOverheadNanoseconds) ||
+            !reader.Read(io_capture.m_nestingOverheadNanoseconds) ||
+            !reader.Read(io_capture.m_calibrationRegionCount) ||
+            !reader.Read(counterCount) ||
+            counterCount > reader.GetRemainingSize() / sizeof(uint32_t)) {
+            return false;
+        }
+
+        io_capture.m_cpuTime = cpuTime != 0;
+        io_capture.m_allocations = allocations != 0;
+        io_capture.m_counterNames.resize(counterCount);
+        for (std::string& name : io_capture.m_counterNames) {
+            if (!reader.ReadString(name)) {
+                return false;
+            }
+        }
+    } else if (i_tag == c_droppedTag) {
+        if (!reader.Read(io_capture.m_droppedRecordCount)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ProfileTraceRead(const char* i_path, ProfileCapture& o_capture)
+{
+    o_capture = ProfileCapture();
+
+    FILE* file = fopen(i_path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    // Mapping files left by crashed processes are read alike.
+    char magic[sizeof(c_traceMagic)];
+    if (fread(magic, sizeof(magic), 1, file) == 1 &&
+        memcmp(magic, "EULERMAP", sizeof(magic)) == 0) {
+        fclose(file);
+        return ProfileMappingRead(i_path, o_capture);
+    }
+
+    uint32_t version = 0;
+    if (memcmp(magic, c_traceMagic, sizeof(magic)) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        version != c_profileTraceVersion ||
+        fread(&o_capture.m_nanosecondsPerTick,
+              sizeof(o_capture.m_nanosecondsPerTick),
+              1,
+              file) != 1) {
+        fclose(file);
+        return false;
+    }
+
+    // The size of each block is checked against the bytes left in the file
+    // before allocating its payload, as damaged traces may hold any size.
+    long position = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long end = ftell(file);
+    fseek(file, position, SEEK_SET);
+    uint64_t remainingSize =
+        position >= 0 && end > position ? (uint64_t)(end - position) : 0;
+
+    // Blocks are read until the end marker, or until a truncated block, which
+    // is expected of a trace that was never closed.
+    bool succeeded = true;
+    std::vector<char> payload;
+    while (true) {
+        uint32_t tag = 0;
+        uint64_t size = 0;
+        if (fread(&tag, sizeof(tag), 1, file) != 1 ||
+            fread(&size, sizeof(size), 1, file) != 1 || tag == c_endTag) {
+            break;
+        }
+
+        remainingSize -= std::min<uint64_t>(
+            remainingSize, sizeof(tag) + sizeof(size));
+        if (size > remainingSize) {
+            break;
+        }
+        remainingSize -= size;
+
+        payload.resize(size);
+        if (size > 0 && fread(payload.data(), size, 1, file) != 1) {
+            break;
+        }
+
+        if (!_ReadBlock(tag, payload, o_capture)) {
+            succeeded = false;
+            break;
+        }
+    }
+    fclose(file);
+
+    // Regions which were open when the trace was written, as the process
+    // crashed, are closed where the trace ends.
+    o_capture.m_records.insert(o_capture.m_records.end(),
+                               o_capture.m_openRecords.begin(),
+                               o_capture.m_openRecords.end());
+
+    // Traces which were never closed lack their site table and statistics.
+    bool hasStatistics = !o_capture.m_siteStatistics.empty();
+    ProfileCaptureAddMissingSites(o_capture);
+    ProfileCaptureSortRecords(o_capture);
+    if (!hasStatistics) {
+        ProfileCaptureComputeStatistics(o_capture);
+    }
+
+    return succeeded;
+}
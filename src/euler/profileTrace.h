@@ -0,0 +1,181 @@
+#pragma once
+
+/// \file profileTrace.h
+///
+/// Binary trace files, into which profiled records are streamed as they are
+/// authored, for captures which outgrow the in-memory record buffers.
+
+#include <euler/api.h>
+#include <euler/bufferedWriter.h>
+#include <euler/profileCapture.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// Version of the trace format written by \ref ProfileTraceWriter, and the
+/// only one read by \ref ProfileTraceRead.
+constexpr uint32_t c_profileTraceVersion = 3;
+
+/// \class ProfileTraceWriter
+///
+/// Writes a trace file, made of a header followed by a sequence of tagged
+/// blocks:
+/// - the site table, the statistics of each site, the quantities measured
+///   alongside and the number of dropped records, which are written last
+///   when streaming;
+/// - record blocks, each holding a batch of records of a single thread;
+/// - sample blocks, each holding a batch of samples of the counter and gauge
+///   tracks, and ends of asynchronous spans, of a single thread.
+///
+/// The fields of each record are packed as variable-length integers, where
+/// start ticks and identifiers are encoded relative to the previous record of
+/// the block, and stop ticks and parents relative to the record itself.  Each
+/// block is thus decoded independently, in about a third of the size of the
+/// raw records.
+///
+/// Fixed-size values are written in the byte order of the host.  Readers skip
+/// the blocks they do not know of, and a trace which was never closed still
+/// yields the records written so far.
+class EULER_API ProfileTraceWriter final
+{
+public:
+    ProfileTraceWriter() = default;
+    ~ProfileTraceWriter() = default;
+
+    // Cannot be copied.
+    ProfileTraceWriter(const ProfileTraceWriter& i_writer) = delete;
+    ProfileTraceWriter& operator=(const ProfileTraceWriter& i_writer) = delete;
+
+    /// Open \p i_path and write the header of a trace whose records are timed
+    /// in ticks of \p i_nanosecondsPerTick nanoseconds.
+    ///
+    /// \return false if the file could not be opened.
+    bool Open(const char* i_path, double i_nanosecondsPerTick);
+
+    /// Write a block of \p i_recordCount records of the thread at
+    /// \p i_threadIndex.
+    void WriteRecords(uint16_t i_threadIndex,
+                      const ProfileRecord* i_records,
+                      uint32_t i_recordCount);
+
+    /// Write a block of \p i_sampleCount samples of the thread at
+    /// \p i_threadIndex.
+    void WriteSamples(uint16_t i_threadIndex,
+                      const ProfileSample* i_samples,
+                      uint32_t i_sampleCount);
+
+    /// Write the sites, site statistics, measurement settings and dropped
+    /// record count of \p i_summary, whose records are ignored.
+    ///
+    /// The performance counter deltas of each record are not written, only
+    /// their totals per site.
+    void WriteSummary(const ProfileCapture& i_summary);
+
+    /// Mark the end of the trace and close the file.
+    ///
+    /// \return false if any write since Open() has failed.
+    bool Close();
+
+private:
+    /// Write a block tagged \p i_tag, holding \ref m_payload.
+    void WriteBlock(uint32_t i_tag);
+
+    BufferedWriter m_writer;
+
+    /// Scratch memory for encoding block payloads.
+    std::vector<char> m_payload;
+};
+
+/// \class ProfileTraceSignalWriter
+///
+/// Writes a trace with write(2), without allocating memory nor taking locks,
+/// such that it can be used from signal handlers.
+///
+/// Sites are written one per block, and the regions which are still open are
+/// written to blocks of their own, which readers close where the trace ends.
+/// Only supported on POSIX systems.
+class EULER_API ProfileTraceSignalWriter final
+{
+public:
+    ProfileTraceSignalWriter() = default;
+    ~ProfileTraceSignalWriter() = default;
+
+    // Cannot be copied.
+    ProfileTraceSignalWriter(const ProfileTraceSignalWriter& i_writer) =
+        delete;
+    ProfileTraceSignalWriter& operator=(
+        const ProfileTraceSignalWriter& i_writer) = delete;
+
+    /// Create \p i_path and write the header of a trace whose records are
+    /// timed in ticks of \p i_nanosecondsPerTick nanoseconds.
+    ///
+    /// \return false if the file could not be created.
+    bool Open(const char* i_path, double i_nanosecondsPerTick);
+
+    /// Write the next site of the site table.
+    void WriteSite(const char* i_file,
+                   uint32_t i_line,
+                   const char* i_name,
+                   uint32_t i_sampleRate);
+
+    /// Write the number of dropped records.
+    void WriteDroppedRecordCount(uint64_t i_count);
+
+    /// Write \p i_recordCount records of the thread at \p i_threadIndex.
+    void WriteRecords(uint16_t i_threadIndex,
+                      const ProfileRecord* i_records,
+                      uint32_t i_recordCount);
+
+    /// Write the \p i_recordCount regions still open on the thread at
+    /// \p i_threadIndex, outermost first.
+    void WriteOpenRecords(uint16_t i_threadIndex,
+                          const ProfileRecord* i_records,
+                          uint32_t i_recordCount);
+
+    /// Write \p i_sampleCount samples of the thread at \p i_threadIndex.
+    void WriteSamples(uint16_t i_threadIndex,
+                      const ProfileSample* i_samples,
+                      uint32_t i_sampleCount);
+
+    /// Mark the end of the trace and close the file.
+    void Close();
+
+private:
+    /// Maximum number of records or samples per block.
+    static constexpr uint32_t c_blockRecordCount = 1024;
+
+    /// Write blocks tagged \p i_tag of packed records.
+    void WritePackedRecords(uint32_t i_tag,
+                            uint16_t i_threadIndex,
+                            const ProfileRecord* i_records,
+                            uint32_t i_recordCount);
+
+    /// Write \p i_size bytes to the file, retrying partial writes.
+    void WriteBytes(const void* i_bytes, size_t i_size);
+
+    int m_file = -1;
+
+    /// Scratch memory for packing records, of the worst-case size of a block.
+    char m_payload[16 + c_blockRecordCount * 64];
+};
+
+/// Write \p i_capture to \p i_path in the trace format, with the records of
+/// each thread in their own blocks, but without the performance counter
+/// deltas of each record.
+///
+/// \return false if the file could not be written.
+EULER_API
+bool ProfileCaptureExportTrace(const ProfileCapture& i_capture,
+                               const char* i_path);
+
+/// Read the trace file at \p i_path into \p o_capture.  Mapping files are
+/// read with \ref ProfileMappingRead.
+///
+/// Sites missing from the trace, as it was never closed, are named after
+/// their identifier, and have no statistics.
+///
+/// \return false if the file could not be read, or is not a trace of a
+/// supported version.
+EULER_API
+bool ProfileTraceRead(const char* i_path, ProfileCapture& o_capture);
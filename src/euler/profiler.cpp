@@ -1,224 +1,2549 @@
 #include "profiler.h"
+#include "histogram.h"
+#include "profileAllocations.h"
+#include "profileCapture.h"
+#include "profileCounters.h"
+#include "profileMapping.h"
+#include "profileTrace.h"
 
 #include <algorithm>
+#include <array>
 #include <atomic>
-#include <cstring>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
-#include <sstream>
-#include <stdio.h>
-#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <thread>
+#include <time.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define EULER_PROFILER_HAS_TSC 1
+#    include <cpuid.h>
+#    include <x86intrin.h>
+#else
+#    define EULER_PROFILER_HAS_TSC 0
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define EULER_PROFILER_HAS_SIGNALS 1
+#    include <signal.h>
+#else
+#    define EULER_PROFILER_HAS_SIGNALS 0
+#endif
+
+/// Timestamp source selected at setup.
+static ProfilerClock g_profilerClock = ProfilerClock::Monotonic;
+
+/// Conversion factor from the ticks of \ref g_profilerClock to nanoseconds.
+static double g_nanosecondsPerTick = 1.0;
+
+/// Sampling rate of the sites which do not specify their own.
+static uint32_t g_profilerSampleRate = 1;
+
+std::atomic<uint32_t> g_profilerCategoryMask{ ~0u };
+
+/// Behavior of threads whose records have not been drained in time.
+static ProfilerOverflow g_profilerOverflow = ProfilerOverflow::Drop;
+
+/// Is the drain thread running, such that stalled threads will be released?
+static std::atomic_bool g_profilerDraining{ false };
+
+/// Duration of the windows over which the call rate of each site is measured,
+/// for throttling.
+constexpr uint64_t c_throttleWindowNanoseconds = 10000000;
+
+/// Duration of a throttling window, in ticks.
+static uint64_t g_throttleWindowTicks = 0;
+
+/// Number of records a site may author per thread in a throttling window, or
+/// 0 if throttling is disabled.
+static uint64_t g_throttleWindowLimit = 0;
+
+/// Are performance counters collected by each thread?
+static bool g_profilerCounters = false;
+
+/// Set of performance counters available, selected at setup.
+static ProfileCounterSet g_profilerCounterSet = ProfileCounterSet::Hardware;
+
+/// Is the CPU time of each region measured, alongside its wall time?
+static bool g_profilerCpuTime = false;
+
+/// Are heap allocations attributed to the innermost open region?
+static bool g_profilerAllocations = false;
+
+/// Is the calling thread allocating on behalf of the profiler, rather than of
+/// the profiled region?
+static thread_local bool tl_profilerAllocating = false;
+
+/// Calibrated overhead of profiling a region, which falls between its own
+/// timestamps, in ticks.
+static uint64_t g_scopeOverheadTicks = 0;
+
+/// Calibrated overhead of profiling a region, which falls within its
+/// enclosing region, in ticks.
+static uint64_t g_nestingOverheadTicks = 0;
+
+/// Number of regions of which g_scopeOverheadTicks is the median.
+static uint32_t g_calibrationRegionCount = 0;
+
+// Read CLOCK_MONOTONIC in nanoseconds.
+static uint64_t _ReadMonotonicNanoseconds()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+// Read the CPU time consumed by the calling thread in nanoseconds, or 0 if
+// the system does not measure it.
+static uint64_t _ReadThreadCpuNanoseconds()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+// Is the time-stamp counter invariant across P-, C- and T-states, such that
+// it can be used as a wall clock?
+static bool _HasInvariantTSC()
+{
+#if EULER_PROFILER_HAS_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+        eax < 0x80000007) {
+        return false;
+    }
+
+    // Invariant TSC is reported by CPUID.80000007H:EDX[8].
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+// Measure the number of nanoseconds per time-stamp counter tick against
+// CLOCK_MONOTONIC.
+static double _CalibrateTSC()
+{
+#if EULER_PROFILER_HAS_TSC
+    // Spin for a fixed wall duration, which is long enough for the error of
+    // the two reads at either end to become insignificant.
+    constexpr uint64_t c_calibrationNanoseconds = 20000000;
+
+    uint64_t startNanoseconds = _ReadMonotonicNanoseconds();
+    uint64_t startTicks = __rdtsc();
+    uint64_t stopNanoseconds = startNanoseconds;
+    while (stopNanoseconds - startNanoseconds < c_calibrationNanoseconds) {
+        stopNanoseconds = _ReadMonotonicNanoseconds();
+    }
+    uint64_t stopTicks = __rdtsc();
+
+    return (double)(stopNanoseconds - startNanoseconds) /
+           (double)(stopTicks - startTicks);
+#else
+    return 1.0;
+#endif
+}
+
+// Read the timestamp marking the beginning of a profiled region.
+static inline uint64_t _ReadStartTimestamp()
+{
+#if EULER_PROFILER_HAS_TSC
+    if (g_profilerClock == ProfilerClock::TSC) {
+        return __rdtsc();
+    }
+#endif
+    return _ReadMonotonicNanoseconds();
+}
+
+// Read the timestamp marking the end of a profiled region.
+//
+// rdtscp waits for the preceding instructions to retire, so the profiled
+// work cannot leak past the stop timestamp.
+static inline uint64_t _ReadStopTimestamp()
+{
+#if EULER_PROFILER_HAS_TSC
+    if (g_profilerClock == ProfilerClock::TSC) {
+        unsigned int processor;
+        return __rdtscp(&processor);
+    }
+#endif
+    return _ReadMonotonicNanoseconds();
+}
+
+// Get the rate at which entries of \p i_site are sampled.
+static uint32_t _GetSampleRate(const ProfileSite& i_site)
+{
+    return i_site.GetSampleRate() != 0 ? i_site.GetSampleRate()
+                                       : g_profilerSampleRate;
+}
+
+// Draw the number of entries to skip before the next sampled entry of a site
+// sampled at \p i_sampleRate.
+//
+// The interval is drawn uniformly from [0, 2 * (rate - 1)], rather than being
+// fixed, so that nested sites sampled at the same rate are not sampled in
+// lockstep, which would bias the estimated self time of their parents.
+static uint32_t _DrawSampleInterval(uint32_t i_sampleRate)
+{
+    // Xorshift32, seeded differently on each thread.
+    static thread_local uint32_t tl_sampleState = 0;
+    if (tl_sampleState == 0) {
+        tl_sampleState = 2463534242u ^ (uint32_t)(uintptr_t)&tl_sampleState;
+        tl_sampleState = tl_sampleState != 0 ? tl_sampleState : 1;
+    }
+    tl_sampleState ^= tl_sampleState << 13;
+    tl_sampleState ^= tl_sampleState >> 17;
+    tl_sampleState ^= tl_sampleState << 5;
+
+    uint64_t range = 2 * (uint64_t)(i_sampleRate - 1) + 1;
+    return (uint32_t)(tl_sampleState % range);
+}
+
+// Does the glob \p i_pattern match the whole of \p i_text?  '*' matches any
+// sequence of characters, and '?' any single character.
+static bool _MatchGlob(const char* i_pattern, const char* i_text)
+{
+    // Upon a mismatch, backtrack to just after the last '*', which then
+    // swallows one more character of the text.
+    const char* starPattern = nullptr;
+    const char* starText = nullptr;
+    while (*i_text != '\0') {
+        if (*i_pattern == '*') {
+            starPattern = ++i_pattern;
+            starText = i_text;
+        } else if (*i_pattern != '\0' &&
+                   (*i_pattern == '?' || *i_pattern == *i_text)) {
+            ++i_pattern;
+            ++i_text;
+        } else if (starPattern != nullptr) {
+            i_pattern = starPattern;
+            i_text = ++starText;
+        } else {
+            return false;
+        }
+    }
+
+    while (*i_pattern == '*') {
+        ++i_pattern;
+    }
+
+    return *i_pattern == '\0';
+}
+
+/// \class ProfilePublishedArray
+///
+/// Append-only array of pointers, which may be read without locking, from
+/// signal handlers, while another thread appends to it.
+///
+/// Entries are stored in blocks which are never reallocated, and published
+/// by releasing the size, such that readers only visit complete entries.
+/// Holds up to 65536 entries, as many as there are thread indices.
+template <typename T>
+class ProfilePublishedArray final
+{
+public:
+    ProfilePublishedArray()
+    {
+        for (std::atomic<Block*>& block : m_blocks) {
+            block.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ProfilePublishedArray()
+    {
+        for (std::atomic<Block*>& block : m_blocks) {
+            delete block.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Cannot copy.
+    ProfilePublishedArray(const ProfilePublishedArray&) = delete;
+    ProfilePublishedArray& operator=(const ProfilePublishedArray&) = delete;
+
+    /// Append \p i_entry.  Appends must be serialized by the caller.
+    ///
+    /// \return false if the array is full.
+    bool Append(T* i_entry)
+    {
+        uint32_t size = m_size.load(std::memory_order_relaxed);
+        if (size == c_blockSize * c_blockCount) {
+            return false;
+        }
 
-// Compute the timespec duration between \p i_start and \p i_stop.
-static timespec _ComputeDuration(const timespec& i_start,
-                                 const timespec& i_stop)
+        std::atomic<Block*>& block = m_blocks[size / c_blockSize];
+        if (block.load(std::memory_order_relaxed) == nullptr) {
+            block.store(new Block(), std::memory_order_relaxed);
+        }
+        (*block.load(std::memory_order_relaxed))[size % c_blockSize] = i_entry;
+        m_size.store(size + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Get the number of published entries.
+    uint32_t GetSize() const { return m_size.load(std::memory_order_acquire); }
+
+    /// Get the entry at \p i_index, which must be less than a size returned
+    /// by GetSize().
+    T* Get(uint32_t i_index) const
+    {
+        return (*m_blocks[i_index / c_blockSize].load(
+            std::memory_order_relaxed))[i_index % c_blockSize];
+    }
+
+private:
+    static constexpr uint32_t c_blockSize = 256;
+    static constexpr uint32_t c_blockCount = 256;
+
+    using Block = std::array<T*, c_blockSize>;
+
+    std::atomic<Block*> m_blocks[c_blockCount];
+    std::atomic<uint32_t> m_size{ 0 };
+};
+
+/// \class ProfileSiteRegistry
+///
+/// Interned call sites, indexed by their identifiers.
+class ProfileSiteRegistry final
 {
-    timespec duration;
-    if ((i_stop.tv_nsec - i_start.tv_nsec) < 0) {
-        duration.tv_sec = i_stop.tv_sec - i_start.tv_sec - 1;
-        duration.tv_nsec = i_stop.tv_nsec - i_start.tv_nsec + 1e9;
-    } else {
-        duration.tv_sec = i_stop.tv_sec - i_start.tv_sec;
-        duration.tv_nsec = i_stop.tv_nsec - i_start.tv_nsec;
+public:
+    /// Get the registry, which is constructed upon first use as sites are
+    /// static objects which may be constructed before this translation unit's
+    /// globals.
+    static ProfileSiteRegistry& Get()
+    {
+        static ProfileSiteRegistry s_registry;
+        return s_registry;
+    }
+
+    /// Register \p i_site and return its identifier.
+    uint32_t Register(const ProfileSite* i_site)
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        _ApplyFilter(i_site);
+        tl_profilerAllocating = true;
+        m_sites.push_back(i_site);
+        m_publishedSites.Append(i_site);
+        tl_profilerAllocating = false;
+        if (m_mapping != nullptr) {
+            _MapSite(i_site);
+        }
+        return m_sites.size() - 1;
+    }
+
+    /// Write all the registered sites, and the sites which register from now
+    /// on, into the site table of \p i_mapping, or stop writing sites if
+    /// nullptr.
+    void SetMapping(ProfileMapping* i_mapping)
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_mapping = i_mapping;
+        if (m_mapping != nullptr) {
+            for (const ProfileSite* site : m_sites) {
+                _MapSite(site);
+            }
+        }
+    }
+
+    /// Only enable the sites matching \p i_filter, as described by
+    /// \ref ProfilerOptions::m_filter.
+    void SetFilter(const char* i_filter)
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_patterns.clear();
+        if (i_filter != nullptr && *i_filter != '\0') {
+            // Patterns are unanchored, as names are decorated by
+            // __PRETTY_FUNCTION__.
+            const char* pattern = i_filter;
+            while (true) {
+                const char* separator = strchr(pattern, '|');
+                size_t size = separator != nullptr ? separator - pattern
+                                                   : strlen(pattern);
+                m_patterns.push_back("*" + std::string(pattern, size) + "*");
+                if (separator == nullptr) {
+                    break;
+                }
+                pattern = separator + 1;
+            }
+        }
+
+        for (const ProfileSite* site : m_sites) {
+            _ApplyFilter(site);
+        }
+    }
+
+    /// Copy the descriptions of all the registered sites into \p o_sites.
+    void GatherSites(std::vector<ProfileCaptureSite>& o_sites)
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        o_sites.resize(m_sites.size());
+        for (size_t siteIndex = 0; siteIndex < m_sites.size(); ++siteIndex) {
+            o_sites[siteIndex].m_file = m_sites[siteIndex]->GetFile();
+            o_sites[siteIndex].m_line = m_sites[siteIndex]->GetLine();
+            o_sites[siteIndex].m_name = m_sites[siteIndex]->GetName();
+            o_sites[siteIndex].m_sampleRate =
+                _GetSampleRate(*m_sites[siteIndex]);
+        }
+    }
+
+    /// Write the descriptions of all the registered sites with \p io_writer.
+    ///
+    /// Does not lock, for use from signal handlers, so only visits the sites
+    /// published so far.
+    void WriteSites(ProfileTraceSignalWriter& io_writer) const
+    {
+        uint32_t siteCount = m_publishedSites.GetSize();
+        for (uint32_t siteIndex = 0; siteIndex < siteCount; ++siteIndex) {
+            const ProfileSite* site = m_publishedSites.Get(siteIndex);
+            io_writer.WriteSite(site->GetFile(),
+                                site->GetLine(),
+                                site->GetName(),
+                                _GetSampleRate(*site));
+        }
+    }
+
+private:
+    /// Enable or disable \p i_site according to the filter.
+    void _ApplyFilter(const ProfileSite* i_site) const
+    {
+        bool enabled = m_patterns.empty();
+        for (const std::string& pattern : m_patterns) {
+            if (_MatchGlob(pattern.c_str(), i_site->GetName())) {
+                enabled = true;
+                break;
+            }
+        }
+
+        i_site->m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    /// Guards registration of sites.
+    std::mutex m_mutex;
+
+    /// Registered sites.
+    std::vector<const ProfileSite*> m_sites;
+
+    /// Registered sites, for readers which cannot lock.
+    ProfilePublishedArray<const ProfileSite> m_publishedSites;
+
+    /// Write \p i_site into the site table of the mapping.
+    void _MapSite(const ProfileSite* i_site) const
+    {
+        m_mapping->AddSite(i_site->GetFile(),
+                           i_site->GetLine(),
+                           i_site->GetName(),
+                           _GetSampleRate(*i_site));
     }
-    return duration;
+
+    /// Glob patterns of the filter, of which sites must match any.
+    std::vector<std::string> m_patterns;
+
+    /// Mapping of the records, whose site table is kept up to date.
+    ProfileMapping* m_mapping = nullptr;
+};
+
+ProfileSite::ProfileSite(const char* i_file,
+                         uint32_t i_line,
+                         const char* i_name,
+                         uint32_t i_sampleRate)
+  : m_file(i_file)
+  , m_line(i_line)
+  , m_name(i_name)
+  , m_sampleRate(i_sampleRate)
+{
+    m_id = ProfileSiteRegistry::Get().Register(this);
 }
 
-// Number of bytes to allocated for per-record string storage.
-constexpr uint32_t c_profileRecordStringCapacity = 80;
+/// \class ProfileSiteAccumulator
+///
+/// Running timing statistics of a call site on a single thread.
+///
+/// Squared durations are accumulated relative to the first sample, which keeps
+/// the variance numerically stable without a division per sample.  The
+/// latency histogram is only allocated upon the first sample, as most of the
+/// accumulators of a block belong to sites which never run on the thread.
+class ProfileSiteAccumulator final
+{
+public:
+    ProfileSiteAccumulator() = default;
+
+    ~ProfileSiteAccumulator()
+    {
+        delete m_histogram.load(std::memory_order_relaxed);
+    }
+
+    /// Cannot copy.
+    ProfileSiteAccumulator(const ProfileSiteAccumulator&) = delete;
+    ProfileSiteAccumulator& operator=(const ProfileSiteAccumulator&) = delete;
+
+    /// Account for a profiled region lasting \p i_ticks, of which
+    /// \p i_selfTicks were not spent in enclosed profiled regions.
+    ///
+    /// Self time may be negative, as enclosed regions of sampled sites are
+    /// charged as an estimate.  It is only clamped once aggregated.
+    void Add(uint64_t i_ticks, int64_t i_selfTicks)
+    {
+        LogLinearHistogram* histogram =
+            m_histogram.load(std::memory_order_relaxed);
+        if (histogram == nullptr) {
+            m_shiftTicks = i_ticks;
+            tl_profilerAllocating = true;
+            histogram = new LogLinearHistogram();
+            tl_profilerAllocating = false;
+            m_histogram.store(histogram, std::memory_order_release);
+        }
+        histogram->Record(i_ticks);
+
+        ++m_count;
+        m_totalTicks += i_ticks;
+        m_selfTicks += i_selfTicks;
+        m_minTicks = std::min(m_minTicks, i_ticks);
+        m_maxTicks = std::max(m_maxTicks, i_ticks);
+
+        double shiftedTicks = (double)i_ticks - (double)m_shiftTicks;
+        m_shiftedSumOfSquares += shiftedTicks * shiftedTicks;
+    }
+
+    /// Account for \p i_cpuNanoseconds of CPU time over a profiled region.
+    void AddCpuTime(uint64_t i_cpuNanoseconds)
+    {
+        m_cpuNanoseconds += i_cpuNanoseconds;
+    }
+
+    /// Account for the heap allocations made directly within a profiled
+    /// region, whose live bytes peaked at \p i_peakLiveBytes.
+    void AddAllocations(uint64_t i_count,
+                        uint64_t i_bytes,
+                        uint64_t i_peakLiveBytes)
+    {
+        m_allocationCount += i_count;
+        m_allocatedBytes += i_bytes;
+        m_peakLiveBytes = std::max(m_peakLiveBytes, i_peakLiveBytes);
+    }
+
+    /// Account for the performance counter deltas of a profiled region.
+    void AddCounters(const uint64_t* i_counters)
+    {
+        for (uint32_t counterIndex = 0; counterIndex < c_maxProfileCounters;
+             ++counterIndex) {
+            m_counterTotals[counterIndex] += i_counters[counterIndex];
+        }
+    }
+
+    // Members.
+    uint64_t m_count = 0;
+    uint64_t m_totalTicks = 0;
+    int64_t m_selfTicks = 0;
+    uint64_t m_minTicks = UINT64_MAX;
+    uint64_t m_maxTicks = 0;
+    uint64_t m_shiftTicks = 0;
+    double m_shiftedSumOfSquares = 0.0;
+    std::atomic<LogLinearHistogram*> m_histogram{ nullptr };
+    uint64_t m_cpuNanoseconds = 0;
+    uint64_t m_allocationCount = 0;
+    uint64_t m_allocatedBytes = 0;
+    uint64_t m_peakLiveBytes = 0;
+    uint64_t m_counterTotals[c_maxProfileCounters] = {};
+
+    /// Number of entries left to skip before the next sampled entry.
+    uint32_t m_sampleCountdown = 0;
+
+    /// Should the record of a region of this site, stopping at \p i_stop, be
+    /// dropped because the site is called too often?
+    ///
+    /// Once a site exceeds the rate limit within a window, it only contributes
+    /// to the statistics, until a whole window stays within the limit.
+    bool Throttle(uint64_t i_stop)
+    {
+        if (g_throttleWindowLimit == 0) {
+            return false;
+        }
+
+        // The windows without any region, which lapsed since the last one,
+        // were within the limit.
+        uint64_t elapsedTicks = i_stop - m_windowStart;
+        if (elapsedTicks >= g_throttleWindowTicks) {
+            if (m_windowCount <= g_throttleWindowLimit ||
+                elapsedTicks >= 2 * g_throttleWindowTicks) {
+                m_windowThrottled = false;
+            }
+            m_windowStart = i_stop;
+            m_windowCount = 0;
+        }
+
+        if (++m_windowCount > g_throttleWindowLimit && !m_windowThrottled) {
+            m_windowThrottled = true;
+            m_throttled.store(true, std::memory_order_relaxed);
+        }
+
+        return m_windowThrottled;
+    }
+
+    /// Start of the current throttling window.
+    uint64_t m_windowStart = 0;
+
+    /// Number of regions which stopped in the current throttling window.
+    uint64_t m_windowCount = 0;
+
+    /// Is this site currently throttled?
+    bool m_windowThrottled = false;
+
+    /// Has this site exceeded the rate limit at any point?
+    std::atomic_bool m_throttled{ false };
+};
+
+/// \class ProfileSiteMoments
+///
+/// Timing statistics of a call site merged across threads.
+class ProfileSiteMoments final
+{
+public:
+    /// Merge the samples of \p i_accumulator, following the pairwise update of
+    /// Chan et al.
+    void Merge(const ProfileSiteAccumulator& i_accumulator)
+    {
+        const LogLinearHistogram* histogram =
+            i_accumulator.m_histogram.load(std::memory_order_acquire);
+        uint64_t count = i_accumulator.m_count;
+        if (histogram == nullptr || count == 0) {
+            return;
+        }
+        m_histogram.Merge(*histogram);
+
+        double mean = (double)i_accumulator.m_totalTicks / count;
+        double shiftedMean = mean - (double)i_accumulator.m_shiftTicks;
+        double squaredDeviations = std::max(
+            0.0,
+            i_accumulator.m_shiftedSumOfSquares -
+                count * shiftedMean * shiftedMean);
+
+        uint64_t mergedCount = m_count + count;
+        double delta = mean - m_mean;
+        m_mean += delta * count / mergedCount;
+        m_squaredDeviations += squaredDeviations +
+                               delta * delta * m_count * count / mergedCount;
+        m_count = mergedCount;
+        m_totalTicks += i_accumulator.m_totalTicks;
+        m_selfTicks += i_accumulator.m_selfTicks;
+        m_minTicks = std::min(m_minTicks, i_accumulator.m_minTicks);
+        m_maxTicks = std::max(m_maxTicks, i_accumulator.m_maxTicks);
+        m_cpuNanoseconds += i_accumulator.m_cpuNanoseconds;
+        m_allocationCount += i_accumulator.m_allocationCount;
+        m_allocatedBytes += i_accumulator.m_allocatedBytes;
+        m_peakLiveBytes =
+            std::max(m_peakLiveBytes, i_accumulator.m_peakLiveBytes);
+        for (uint32_t counterIndex = 0; counterIndex < c_maxProfileCounters;
+             ++counterIndex) {
+            m_counterTotals[counterIndex] +=
+                i_accumulator.m_counterTotals[counterIndex];
+        }
+    }
+
+    /// Convert into nanosecond statistics, given the duration of a tick.
+    ///
+    /// Counts and totals are scaled up by \p i_sampleRate, to estimate the
+    /// entries which have been skipped by sampling.
+    ProfileSiteStatistics GetStatistics(double i_nanosecondsPerTick,
+                                        uint32_t i_sampleRate) const
+    {
+        ProfileSiteStatistics statistics;
+        if (m_count > 0) {
+            statistics.m_count = m_count * i_sampleRate;
+            statistics.m_totalNanoseconds =
+                (uint64_t)(m_totalTicks * i_nanosecondsPerTick * i_sampleRate);
+            statistics.m_selfNanoseconds = (uint64_t)(
+                std::max<int64_t>(m_selfTicks, 0) * i_nanosecondsPerTick *
+                i_sampleRate);
+            statistics.m_minNanoseconds =
+                (uint64_t)(m_minTicks * i_nanosecondsPerTick);
+            statistics.m_maxNanoseconds =
+                (uint64_t)(m_maxTicks * i_nanosecondsPerTick);
+            statistics.m_meanNanoseconds = m_mean * i_nanosecondsPerTick;
+            statistics.m_stddevNanoseconds =
+                std::sqrt(m_squaredDeviations / m_count) * i_nanosecondsPerTick;
+
+            // Bucket bounds can overshoot the largest recorded duration.
+            auto percentile = [&](double i_percentile) {
+                uint64_t ticks = std::min(
+                    m_histogram.GetValueAtPercentile(i_percentile), m_maxTicks);
+                return (uint64_t)(ticks * i_nanosecondsPerTick);
+            };
+            statistics.m_p50Nanoseconds = percentile(50.0);
+            statistics.m_p90Nanoseconds = percentile(90.0);
+            statistics.m_p99Nanoseconds = percentile(99.0);
+            statistics.m_p999Nanoseconds = percentile(99.9);
+            statistics.m_cpuNanoseconds = m_cpuNanoseconds * i_sampleRate;
+            statistics.m_allocationCount = m_allocationCount * i_sampleRate;
+            statistics.m_allocatedBytes = m_allocatedBytes * i_sampleRate;
+            statistics.m_peakLiveBytes = m_peakLiveBytes;
+            for (uint32_t counterIndex = 0;
+                 counterIndex < c_maxProfileCounters;
+                 ++counterIndex) {
+                statistics.m_counterTotals[counterIndex] =
+                    m_counterTotals[counterIndex] * i_sampleRate;
+            }
+        }
+
+        return statistics;
+    }
+
+private:
+    uint64_t m_count = 0;
+    uint64_t m_totalTicks = 0;
+    int64_t m_selfTicks = 0;
+    uint64_t m_minTicks = UINT64_MAX;
+    uint64_t m_maxTicks = 0;
+    double m_mean = 0.0;
+    double m_squaredDeviations = 0.0;
+    LogLinearHistogram m_histogram;
+    uint64_t m_cpuNanoseconds = 0;
+    uint64_t m_allocationCount = 0;
+    uint64_t m_allocatedBytes = 0;
+    uint64_t m_peakLiveBytes = 0;
+    uint64_t m_counterTotals[c_maxProfileCounters] = {};
+};
+
+/// Number of sites per lazily allocated block of accumulators.
+constexpr uint32_t c_siteBlockSize = 256;
+
+/// Number of blocks of accumulators per thread, which bounds the number of
+/// sites to gather statistics for.
+constexpr uint32_t c_siteBlockCount = 256;
+
+/// Block of accumulators for consecutive sites.
+using ProfileSiteAccumulatorBlock =
+    std::array<ProfileSiteAccumulator, c_siteBlockSize>;
+
+/// \class ProfileAllocationFrame
+///
+/// Heap allocations made by a thread within one of its open regions.
+class ProfileAllocationFrame final
+{
+public:
+    /// Live bytes of the thread as the region opened.
+    int64_t m_liveBytesStart = 0;
+
+    /// Peak of the live bytes of the thread over the region, relative to
+    /// \ref m_liveBytesStart, including enclosed regions.
+    int64_t m_peakLiveBytes = 0;
+
+    /// Allocations made directly within the region, excluding enclosed
+    /// regions.
+    uint64_t m_count = 0;
+    uint64_t m_bytes = 0;
+};
+
+/// \class ProfileRecordBuffer
+///
+/// Ring of profile records authored by a single thread.
+///
+/// Only the owning thread checks out records, so advancing the ring does not
+/// require any read-modify-write on shared state.  The count of published
+/// records is still atomic so the report can read a consistent size from
+/// another thread.
+///
+/// The records and open frames are either allocated on the heap, or live in
+/// the slot of a \ref ProfileMapping, to survive a crash of the process.
+///
+/// The buffer also holds the thread's running statistics of each site.  These
+/// are stored in blocks which are never reallocated, so the report can read
+/// them while the thread keeps profiling.
+class ProfileRecordBuffer final
+{
+public:
+    /// \param i_mapping the mapping to store records and frames into, or
+    /// nullptr to allocate them on the heap.
+    /// \param i_streaming are records streamed to a trace file, rather than
+    /// overwritten once the buffer is full?
+    ProfileRecordBuffer(uint32_t i_recordCapacity,
+                        uint16_t i_threadIndex,
+                        ProfileMapping* i_mapping,
+                        bool i_streaming)
+      : m_threadIndex(i_threadIndex)
+      , m_streaming(i_streaming)
+      , m_capacity(i_recordCapacity)
+    {
+        if (i_mapping == nullptr ||
+            !i_mapping->MapThread(m_frames, m_records)) {
+            m_heapFrames.resize(c_maxStackDepth);
+            m_heapRecords.resize(i_recordCapacity);
+            m_frames = m_heapFrames.data();
+            m_records = m_heapRecords.data();
+        }
+        // Whether CPU time and allocations are tracked is fixed for the
+        // lifetime of the buffer, which may outlive the setup it was created
+        // under, as the buffers of sessions do.
+        if (g_profilerCpuTime) {
+            m_cpuStarts.resize(c_maxStackDepth);
+        }
+        if (g_profilerAllocations) {
+            m_allocationFrames.resize(c_maxStackDepth);
+        }
+        for (std::atomic<ProfileSiteAccumulatorBlock*>& block : m_siteBlocks) {
+            block.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ProfileRecordBuffer()
+    {
+        for (std::atomic<ProfileSiteAccumulatorBlock*>& block : m_siteBlocks) {
+            delete block.load(std::memory_order_relaxed);
+        }
+        delete[] m_samples.load(std::memory_order_relaxed);
+    }
+
+    /// Collect the performance counters of \p i_set over each region of the
+    /// owning thread, which must be the calling thread.
+    ///
+    /// \return false if the counters are not available.
+    bool OpenCounters(ProfileCounterSet i_set)
+    {
+        std::unique_ptr<ProfileCounterGroup> counterGroup(
+            new ProfileCounterGroup());
+        if (!counterGroup->Open(i_set)) {
+            return false;
+        }
+
+        m_counterStarts.resize(c_maxStackDepth);
+        m_counterRecords.resize(m_capacity);
+        m_counterGroup = std::move(counterGroup);
+        return true;
+    }
+
+    /// Cannot copy.
+    ProfileRecordBuffer(const ProfileRecordBuffer&) = delete;
+    ProfileRecordBuffer& operator=(const ProfileRecordBuffer&) = delete;
+
+    /// Check out the next record to author timing and metadata into, which
+    /// is published by Commit().
+    ///
+    /// Must only be called from the owning thread.
+    ///
+    /// \return nullptr if the record must be dropped, as the records it would
+    /// overwrite have yet to be streamed.
+    ProfileRecord* Checkout()
+    {
+        if (m_streaming) {
+            uint64_t recordCount =
+                m_recordCount.load(std::memory_order_relaxed);
+            if (recordCount - m_drainedCount.load(std::memory_order_acquire) ==
+                    m_capacity &&
+                !WaitForDrain(recordCount)) {
+                m_droppedCount.store(
+                    m_droppedCount.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+
+        return &m_records[m_recordIndex];
+    }
+
+    /// Publish the record returned by the last Checkout().
+    ///
+    /// Must only be called from the owning thread.
+    void Commit()
+    {
+        if (++m_recordIndex == m_capacity) {
+            m_recordIndex = 0;
+        }
+
+        m_recordCount.store(m_recordCount.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_release);
+    }
+
+    /// Write the records and samples published since the last drain to
+    /// \p io_writer.
+    ///
+    /// May be called from any thread, but by a single one at a time.
+    ///
+    /// \return the number of drained records or samples, whichever is
+    /// larger.
+    uint64_t Drain(ProfileTraceWriter& io_writer)
+    {
+        uint64_t sampleBatchCount = DrainSamples(io_writer);
+
+        uint64_t recordCount = m_recordCount.load(std::memory_order_acquire);
+        uint64_t drainedCount = m_drainedCount.load(std::memory_order_relaxed);
+        while (drainedCount != recordCount) {
+            // Published records wrap around the end of the buffer at most
+            // once.
+            uint32_t index = drainedCount % m_capacity;
+            uint32_t batchSize = (uint32_t)std::min<uint64_t>(
+                recordCount - drainedCount, m_capacity - index);
+            io_writer.WriteRecords(m_threadIndex, &m_records[index], batchSize);
+            drainedCount += batchSize;
+        }
+
+        uint64_t batchCount =
+            drainedCount - m_drainedCount.load(std::memory_order_relaxed);
+        m_drainedCount.store(drainedCount, std::memory_order_release);
+        return std::max(batchCount, sampleBatchCount);
+    }
+
+    /// Record a sample of a counter or gauge track of the owning thread,
+    /// which must be the calling thread.
+    ///
+    /// Samples are kept in a ring of their own, of as many entries as the
+    /// records, which is only allocated upon the first sample.  Samples are
+    /// dropped rather than overwriting the ones which have yet to be
+    /// streamed.
+    void AddSample(const ProfileSample& i_sample)
+    {
+        ProfileSample* samples = m_samples.load(std::memory_order_relaxed);
+        if (samples == nullptr) {
+            tl_profilerAllocating = true;
+            samples = new ProfileSample[m_capacity];
+            tl_profilerAllocating = false;
+            m_samples.store(samples, std::memory_order_release);
+        }
+
+        uint64_t sampleCount = m_sampleCount.load(std::memory_order_relaxed);
+        if (m_streaming &&
+            sampleCount - m_drainedSampleCount.load(
+                              std::memory_order_acquire) ==
+                m_capacity) {
+            m_droppedCount.store(
+                m_droppedCount.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            return;
+        }
+
+        samples[m_sampleIndex] = i_sample;
+        samples[m_sampleIndex].m_thread = m_threadIndex;
+        if (++m_sampleIndex == m_capacity) {
+            m_sampleIndex = 0;
+        }
+        m_sampleCount.store(sampleCount + 1, std::memory_order_release);
+    }
+
+    /// Get the number of records allocated.
+    uint32_t GetCapacity() const { return m_capacity; }
+
+    /// Get the number of records dropped by the owning thread.
+    uint64_t GetDroppedCount() const
+    {
+        return m_droppedCount.load(std::memory_order_relaxed);
+    }
+
+    /// Get the accumulator of \p i_site, or nullptr if the site is beyond the
+    /// supported number of sites.
+    ///
+    /// Must only be called from the owning thread.
+    ProfileSiteAccumulator* GetSiteAccumulator(uint32_t i_site)
+    {
+        uint32_t blockIndex = i_site / c_siteBlockSize;
+        if (blockIndex >= c_siteBlockCount) {
+            return nullptr;
+        }
+
+        ProfileSiteAccumulatorBlock* block =
+            m_siteBlocks[blockIndex].load(std::memory_order_relaxed);
+        if (block == nullptr) {
+            tl_profilerAllocating = true;
+            block = new ProfileSiteAccumulatorBlock();
+            tl_profilerAllocating = false;
+            m_siteBlocks[blockIndex].store(block, std::memory_order_release);
+        }
+
+        return &(*block)[i_site % c_siteBlockSize];
+    }
+
+    /// Merge the site statistics of this thread into \p o_moments, indexed
+    /// by site, and flag the sites this thread has throttled in
+    /// \p o_throttled.
+    void GatherStatistics(std::vector<ProfileSiteMoments>& o_moments,
+                          std::vector<bool>& o_throttled) const
+    {
+        for (uint32_t blockIndex = 0; blockIndex < c_siteBlockCount;
+             ++blockIndex) {
+            const ProfileSiteAccumulatorBlock* block =
+                m_siteBlocks[blockIndex].load(std::memory_order_acquire);
+            if (block == nullptr) {
+                continue;
+            }
+
+            for (uint32_t offset = 0; offset < c_siteBlockSize; ++offset) {
+                const ProfileSiteAccumulator& accumulator = (*block)[offset];
+                if (accumulator.m_histogram.load(std::memory_order_relaxed) ==
+                    nullptr) {
+                    continue;
+                }
+
+                uint32_t site = blockIndex * c_siteBlockSize + offset;
+                if (site >= o_moments.size()) {
+                    o_moments.resize(site + 1);
+                    o_throttled.resize(site + 1);
+                }
+                o_moments[site].Merge(accumulator);
+                if (accumulator.m_throttled.load(std::memory_order_relaxed)) {
+                    o_throttled[site] = true;
+                }
+            }
+        }
+    }
+
+    /// Decide whether to profile the current entry of \p i_site, such that
+    /// 1 in every \p i_sampleRate entries is profiled on average.
+    ///
+    /// Must only be called from the owning thread.
+    bool Sample(uint32_t i_site, uint32_t i_sampleRate)
+    {
+        ProfileSiteAccumulator* accumulator = GetSiteAccumulator(i_site);
+        if (accumulator == nullptr) {
+            return true;
+        } else if (accumulator->m_sampleCountdown != 0) {
+            --accumulator->m_sampleCountdown;
+            return false;
+        }
+
+        accumulator->m_sampleCountdown = _DrawSampleInterval(i_sampleRate);
+        return true;
+    }
+
+    /// Open a region of \p i_site on the owning thread, assigning it the next
+    /// region identifier.
+    ///
+    /// \return the frame to author the start timestamp into, or nullptr if the
+    /// maximum stack depth has been reached.
+    ProfileFrame* PushFrame(uint32_t i_site, uint32_t i_sampleRate)
+    {
+        if (m_stack == c_maxStackDepth) {
+            return nullptr;
+        }
+
+        ProfileFrame* frame = &m_frames[m_stack++];
+        frame->m_site = i_site;
+        frame->m_id = ++m_regionCount;
+        frame->m_childTicks = 0;
+        frame->m_sampleRate = i_sampleRate;
+        frame->m_overheadTicks = 0;
+
+        // Counters are read ahead of the start timestamp, so that the system
+        // call is not timed.
+        if (m_counterGroup != nullptr) {
+            m_counterGroup->Read(m_counterStarts[m_stack - 1].data());
+        }
+        if (!m_allocationFrames.empty()) {
+            ProfileAllocationFrame& allocationFrame =
+                m_allocationFrames[m_stack - 1];
+            allocationFrame = ProfileAllocationFrame();
+            allocationFrame.m_liveBytesStart = m_liveBytes;
+        }
+        return frame;
+    }
+
+    /// Start measuring the CPU time of the innermost open region, once its
+    /// start timestamp has been read.
+    ///
+    /// The CPU time of a region is read within its wall time, such that the
+    /// former never exceeds the latter.
+    void StartCpuTime()
+    {
+        if (!m_cpuStarts.empty()) {
+            m_cpuStarts[m_stack - 1] = _ReadThreadCpuNanoseconds();
+        }
+    }
+
+    /// Stop measuring the CPU time of the innermost open region, ahead of its
+    /// stop timestamp.
+    ///
+    /// \return the CPU time consumed by the owning thread, to pass on to
+    /// \ref PopFrame, or 0 if CPU time is not measured.
+    uint64_t StopCpuTime()
+    {
+        return !m_cpuStarts.empty() ? _ReadThreadCpuNanoseconds() : 0;
+    }
+
+    /// Close the innermost open region on the owning thread, and author its
+    /// record and statistics.
+    ///
+    /// The duration of the region is also charged to its enclosing region,
+    /// such that the self time of each region excludes its children.  The
+    /// charge is scaled by the sampling rate, to estimate the time of the
+    /// sibling entries which have been skipped.
+    ///
+    /// The statistics exclude the calibrated overhead of the profiler, if
+    /// any, within the region and its enclosed regions.  \p i_cpuStop is the
+    /// CPU time returned by \ref StopCpuTime.
+    void PopFrame(uint64_t i_stop, uint64_t i_cpuStop)
+    {
+        // The frame is marked as closed right away, for post-mortem readers.
+        const ProfileFrame frame = m_frames[--m_stack];
+        m_frames[m_stack].m_id = 0;
+        uint64_t overheadTicks = g_scopeOverheadTicks + frame.m_overheadTicks;
+        uint64_t measuredTicks = i_stop - frame.m_start;
+        uint64_t ticks =
+            measuredTicks > overheadTicks ? measuredTicks - overheadTicks : 0;
+        if (m_stack > 0) {
+            ProfileFrame& parentFrame = m_frames[m_stack - 1];
+            parentFrame.m_childTicks += ticks * frame.m_sampleRate;
+            parentFrame.m_overheadTicks +=
+                g_nestingOverheadTicks + frame.m_overheadTicks;
+        }
+
+        // The peak of live bytes of the enclosing region includes that of the
+        // closing region, offset by the bytes the former had live already.
+        if (!m_allocationFrames.empty() && m_stack > 0) {
+            const ProfileAllocationFrame& allocationFrame =
+                m_allocationFrames[m_stack];
+            ProfileAllocationFrame& parentFrame =
+                m_allocationFrames[m_stack - 1];
+            parentFrame.m_peakLiveBytes = std::max<int64_t>(
+                parentFrame.m_peakLiveBytes,
+                allocationFrame.m_liveBytesStart -
+                    parentFrame.m_liveBytesStart +
+                    allocationFrame.m_peakLiveBytes);
+        }
+
+        // The overhead is spent on the CPU, so it is subtracted from the CPU
+        // time too.
+        uint64_t cpuNanoseconds = 0;
+        if (!m_cpuStarts.empty()) {
+            uint64_t measuredNanoseconds = i_cpuStop - m_cpuStarts[m_stack];
+            uint64_t overheadNanoseconds =
+                (uint64_t)(overheadTicks * g_nanosecondsPerTick);
+            cpuNanoseconds = measuredNanoseconds > overheadNanoseconds
+                                 ? measuredNanoseconds - overheadNanoseconds
+                                 : 0;
+        }
+
+        std::array<uint64_t, c_maxProfileCounters> counters;
+        if (m_counterGroup != nullptr) {
+            const std::array<uint64_t, c_maxProfileCounters>& starts =
+                m_counterStarts[m_stack];
+            counters = starts;
+            m_counterGroup->Read(counters.data());
+            for (uint32_t counterIndex = 0;
+                 counterIndex < c_maxProfileCounters;
+                 ++counterIndex) {
+                counters[counterIndex] -= starts[counterIndex];
+            }
+        }
+
+        ProfileSiteAccumulator* accumulator = GetSiteAccumulator(frame.m_site);
+        if (accumulator != nullptr) {
+            accumulator->Add(ticks, (int64_t)ticks - (int64_t)frame.m_childTicks);
+            accumulator->AddCpuTime(cpuNanoseconds);
+            if (!m_allocationFrames.empty()) {
+                const ProfileAllocationFrame& allocationFrame =
+                    m_allocationFrames[m_stack];
+                accumulator->AddAllocations(allocationFrame.m_count,
+                                            allocationFrame.m_bytes,
+                                            allocationFrame.m_peakLiveBytes);
+            }
+            if (m_counterGroup != nullptr) {
+                accumulator->AddCounters(counters.data());
+            }
+            if (accumulator->Throttle(i_stop)) {
+                return;
+            }
+        }
+
+        ProfileRecord* record = Checkout();
+        if (record == nullptr) {
+            return;
+        }
+
+        // Counter deltas are kept in a side ring, indexed like the records.
+        if (m_counterGroup != nullptr) {
+            ProfileRecordCounters& recordCounters =
+                m_counterRecords[m_recordIndex];
+            recordCounters.m_thread = m_threadIndex;
+            recordCounters.m_id = frame.m_id;
+            std::copy(
+                counters.begin(), counters.end(), recordCounters.m_values);
+        }
+
+        record->m_start = frame.m_start;
+        record->m_stop = i_stop;
+        record->m_site = frame.m_site;
+        record->m_stack = m_stack;
+        record->m_thread = m_threadIndex;
+        record->m_id = frame.m_id;
+        record->m_parent = m_stack > 0 ? m_frames[m_stack - 1].m_id : 0;
+        Commit();
+    }
+
+    /// Account for \p i_bytes allocated on the heap by the owning thread,
+    /// or freed if negative, within the innermost open region.
+    void AddAllocation(int64_t i_bytes)
+    {
+        m_liveBytes += i_bytes;
+        if (m_stack == 0 || m_allocationFrames.empty()) {
+            return;
+        }
+
+        ProfileAllocationFrame& allocationFrame =
+            m_allocationFrames[m_stack - 1];
+        if (i_bytes > 0) {
+            ++allocationFrame.m_count;
+            allocationFrame.m_bytes += i_bytes;
+        }
+        allocationFrame.m_peakLiveBytes =
+            std::max(allocationFrame.m_peakLiveBytes,
+                     m_liveBytes - allocationFrame.m_liveBytesStart);
+    }
+
+    /// Get the index of the owning thread, in order of registration.
+    uint16_t GetThreadIndex() const { return m_threadIndex; }
+
+    /// Get the records, of which the first GetRecordsSize() are valid.
+    const ProfileRecord* GetRecords() const { return m_records; }
+
+    /// Get the samples, of which the first GetSamplesSize() are valid, or
+    /// nullptr if the owning thread has yet to record any.
+    const ProfileSample* GetSamples() const
+    {
+        return m_samples.load(std::memory_order_acquire);
+    }
+
+    /// Get the size of the samples.
+    uint32_t GetSamplesSize() const
+    {
+        return (uint32_t)std::min<uint64_t>(
+            m_sampleCount.load(std::memory_order_acquire), m_capacity);
+    }
+
+    /// Get the performance counter deltas of the records, indexed like them,
+    /// or nullptr if counters are not collected.
+    const ProfileRecordCounters* GetRecordCounters() const
+    {
+        return m_counterGroup != nullptr ? m_counterRecords.data() : nullptr;
+    }
+
+    /// Get the number of bytes allocated by this buffer.
+    size_t GetMemoryUsage() const
+    {
+        size_t memoryUsage =
+            sizeof(*this) + m_capacity * sizeof(ProfileRecord) +
+            c_maxStackDepth * sizeof(ProfileFrame) +
+            m_counterRecords.size() * sizeof(ProfileRecordCounters) +
+            m_counterStarts.size() * sizeof(m_counterStarts[0]) +
+            m_cpuStarts.size() * sizeof(uint64_t) +
+            m_allocationFrames.size() * sizeof(ProfileAllocationFrame);
+        if (m_samples.load(std::memory_order_relaxed) != nullptr) {
+            memoryUsage += m_capacity * sizeof(ProfileSample);
+        }
+        for (const std::atomic<ProfileSiteAccumulatorBlock*>& block :
+             m_siteBlocks) {
+            const ProfileSiteAccumulatorBlock* siteBlock =
+                block.load(std::memory_order_relaxed);
+            if (siteBlock == nullptr) {
+                continue;
+            }
+
+            memoryUsage += sizeof(ProfileSiteAccumulatorBlock);
+            for (const ProfileSiteAccumulator& accumulator : *siteBlock) {
+                if (accumulator.m_histogram.load(std::memory_order_relaxed) !=
+                    nullptr) {
+                    memoryUsage += sizeof(LogLinearHistogram);
+                }
+            }
+        }
+
+        return memoryUsage;
+    }
+
+    /// Get the size of the records.
+    uint32_t GetRecordsSize() const
+    {
+        // If we have reached capacity at some point, then all records are
+        // valid.
+        return (uint32_t)std::min<uint64_t>(
+            m_recordCount.load(std::memory_order_acquire), m_capacity);
+    }
+
+    /// Write the records, and the regions currently open as if they stopped
+    /// at \p i_stop, with \p io_writer.
+    ///
+    /// Does not lock nor allocate, for use from signal handlers, such that
+    /// the owning thread may be interrupted amidst authoring a record.
+    void WriteCrash(ProfileTraceSignalWriter& io_writer, uint64_t i_stop) const
+    {
+        uint32_t recordsSize = GetRecordsSize();
+        if (recordsSize > 0) {
+            io_writer.WriteRecords(m_threadIndex, m_records, recordsSize);
+        }
+
+        const ProfileSample* samples = GetSamples();
+        uint32_t samplesSize = GetSamplesSize();
+        if (samples != nullptr && samplesSize > 0) {
+            io_writer.WriteSamples(m_threadIndex, samples, samplesSize);
+        }
+
+        static ProfileRecord s_openRecords[c_maxStackDepth];
+        uint16_t stack = std::min(m_stack, c_maxStackDepth);
+        for (uint16_t frameIndex = 0; frameIndex < stack; ++frameIndex) {
+            const ProfileFrame& frame = m_frames[frameIndex];
+            ProfileRecord& record = s_openRecords[frameIndex];
+            record.m_start = frame.m_start;
+            record.m_stop = std::max(frame.m_start, i_stop);
+            record.m_site = frame.m_site;
+            record.m_stack = frameIndex;
+            record.m_thread = m_threadIndex;
+            record.m_id = frame.m_id;
+            record.m_parent =
+                frameIndex > 0 ? m_frames[frameIndex - 1].m_id : 0;
+        }
+        if (stack > 0) {
+            io_writer.WriteOpenRecords(m_threadIndex, s_openRecords, stack);
+        }
+    }
+
+private:
+    /// Write the samples published since the last drain to \p io_writer.
+    ///
+    /// \return the number of drained samples.
+    uint64_t DrainSamples(ProfileTraceWriter& io_writer)
+    {
+        uint64_t sampleCount = m_sampleCount.load(std::memory_order_acquire);
+        uint64_t drainedCount =
+            m_drainedSampleCount.load(std::memory_order_relaxed);
+        const ProfileSample* samples = GetSamples();
+        while (drainedCount != sampleCount) {
+            uint32_t index = drainedCount % m_capacity;
+            uint32_t batchSize = (uint32_t)std::min<uint64_t>(
+                sampleCount - drainedCount, m_capacity - index);
+            io_writer.WriteSamples(m_threadIndex, &samples[index], batchSize);
+            drainedCount += batchSize;
+        }
+
+        uint64_t batchCount =
+            drainedCount - m_drainedSampleCount.load(std::memory_order_relaxed);
+        m_drainedSampleCount.store(drainedCount, std::memory_order_release);
+        return batchCount;
+    }
+
+    /// Wait for the drain to free the record following the \p i_recordCount
+    /// published records, if the overflow behavior is to stall.
+    ///
+    /// \return false if the record must be dropped instead.
+    bool WaitForDrain(uint64_t i_recordCount)
+    {
+        if (g_profilerOverflow != ProfilerOverflow::Stall) {
+            return false;
+        }
+
+        while (i_recordCount - m_drainedCount.load(std::memory_order_acquire) ==
+               m_capacity) {
+            if (!g_profilerDraining.load(std::memory_order_acquire)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+
+        return true;
+    }
+
+    /// Index of the next record to check out.
+    uint32_t m_recordIndex = 0;
+
+    /// Number of records published by the owning thread.
+    std::atomic<uint64_t> m_recordCount{ 0 };
+
+    /// Number of records streamed to the trace file.
+    std::atomic<uint64_t> m_drainedCount{ 0 };
+
+    /// Number of records and samples dropped as the drain fell behind.
+    std::atomic<uint64_t> m_droppedCount{ 0 };
+
+    /// Ring of samples, of \ref m_capacity entries, or nullptr until the
+    /// first sample.
+    std::atomic<ProfileSample*> m_samples{ nullptr };
+
+    /// Index of the next sample to record.
+    uint32_t m_sampleIndex = 0;
+
+    /// Number of samples published by the owning thread.
+    std::atomic<uint64_t> m_sampleCount{ 0 };
+
+    /// Number of samples streamed to the trace file.
+    std::atomic<uint64_t> m_drainedSampleCount{ 0 };
+
+    /// Index of the owning thread.
+    uint16_t m_threadIndex = 0;
+
+    /// Are records streamed to a trace file?
+    bool m_streaming = false;
+
+    /// Number of profiled regions currently open on the owning thread.
+    uint16_t m_stack = 0;
+
+    /// Number of regions opened by the owning thread, which also serves as the
+    /// identifier of the most recent one.
+    uint32_t m_regionCount = 0;
+
+    /// Regions currently open on the owning thread, innermost last, of
+    /// c_maxStackDepth entries.
+    ProfileFrame* m_frames = nullptr;
+
+    /// Ring of records.
+    ProfileRecord* m_records = nullptr;
+    uint32_t m_capacity = 0;
+
+    /// Heap storage of the frames and records, unless they are mapped.
+    std::vector<ProfileFrame> m_heapFrames;
+    std::vector<ProfileRecord> m_heapRecords;
+
+    /// Lazily allocated site statistics.
+    std::atomic<ProfileSiteAccumulatorBlock*> m_siteBlocks[c_siteBlockCount];
+
+    /// Performance counters of the owning thread, if collected.
+    std::unique_ptr<ProfileCounterGroup> m_counterGroup;
+
+    /// Counter values at the start of each open region, indexed like
+    /// \ref m_frames.
+    std::vector<std::array<uint64_t, c_maxProfileCounters>> m_counterStarts;
+
+    /// Ring of counter deltas, indexed like \ref m_records.
+    std::vector<ProfileRecordCounters> m_counterRecords;
+
+    /// CPU time of the owning thread at the start of each open region,
+    /// indexed like \ref m_frames, if measured.
+    std::vector<uint64_t> m_cpuStarts;
+
+    /// Heap allocations of each open region, indexed like \ref m_frames, if
+    /// tracked.
+    std::vector<ProfileAllocationFrame> m_allocationFrames;
+
+    /// Bytes allocated by the owning thread and not yet freed, which may be
+    /// negative as memory is freed by other threads than its allocator.
+    int64_t m_liveBytes = 0;
+};
+
+/// Buffer of the calling thread, and the generation of the container it
+/// belongs to.
+///
+/// The generation (rather than the container address) identifies the
+/// container, as a new container may be allocated at the address of a
+/// torn-down one.
+static thread_local ProfileRecordBuffer* tl_recordBuffer = nullptr;
+static thread_local uint64_t tl_recordBufferGeneration = 0;
+
+#if EULER_PROFILER_HAS_SIGNALS
+
+/// Size of the alternate signal stack of each profiled thread.
+constexpr size_t c_signalStackSize = 1 << 16;
+
+/// Are crash traces written upon fatal signals?
+static std::atomic_bool g_crashHandlersInstalled{ false };
+
+/// \class ProfileSignalStack
+///
+/// Alternate stack of the calling thread, on which the crash trace is written
+/// when the thread's own stack is exhausted.
+class ProfileSignalStack final
+{
+public:
+    ProfileSignalStack() = default;
+
+    /// Disable the stack before freeing it, if it was installed.
+    ~ProfileSignalStack()
+    {
+        if (!m_stack.empty()) {
+            stack_t stack;
+            memset(&stack, 0, sizeof(stack));
+            stack.ss_flags = SS_DISABLE;
+            sigaltstack(&stack, nullptr);
+        }
+    }
+
+    /// Cannot copy.
+    ProfileSignalStack(const ProfileSignalStack&) = delete;
+    ProfileSignalStack& operator=(const ProfileSignalStack&) = delete;
+
+    /// Install the stack, unless the thread already has one.
+    void Install()
+    {
+        stack_t stack;
+        if (!m_stack.empty() || sigaltstack(nullptr, &stack) != 0 ||
+            (stack.ss_flags & SS_DISABLE) == 0) {
+            return;
+        }
+
+        m_stack.resize(c_signalStackSize);
+        memset(&stack, 0, sizeof(stack));
+        stack.ss_sp = m_stack.data();
+        stack.ss_size = m_stack.size();
+        if (sigaltstack(&stack, nullptr) != 0) {
+            m_stack.clear();
+        }
+    }
+
+private:
+    std::vector<char> m_stack;
+};
+
+// Install an alternate signal stack on the calling thread if crash traces
+// are written, such that they are also written upon stack overflows.
+static void _InstallSignalStack()
+{
+    if (g_crashHandlersInstalled.load(std::memory_order_relaxed)) {
+        static thread_local ProfileSignalStack tl_signalStack;
+        tl_signalStack.Install();
+    }
+}
+
+#else
+
+static void _InstallSignalStack()
+{
+}
+
+#endif
+
+// Get the serial number of the calling thread, which is unique over the
+// lifetime of the process, unlike std::thread::id.
+static uint64_t _GetThreadSerial()
+{
+    static std::atomic<uint64_t> s_threadCount{ 0 };
+    static thread_local uint64_t tl_threadSerial = ++s_threadCount;
+    return tl_threadSerial;
+}
+
+/// Store of profile records, of the profiler set up by \ref ProfilerSetup or
+/// of a \ref ProfilerSession.
+///
+/// Each thread lazily registers its own \ref ProfileRecordBuffer upon its
+/// first profiled region.  Buffers are owned by the container, so records
+/// authored by threads which have since exited remain available for reporting.
+class ProfileRecordContainer final
+{
+public:
+    ProfileRecordContainer(uint32_t i_recordCapacity)
+      : m_recordCapacity(i_recordCapacity)
+    {
+        static std::atomic<uint64_t> s_generation{ 0 };
+        m_generation = ++s_generation;
+    }
+
+    ~ProfileRecordContainer() = default;
+
+    /// Cannot copy.
+    ProfileRecordContainer(const ProfileRecordContainer&) = delete;
+    ProfileRecordContainer& operator=(const ProfileRecordContainer&) = delete;
+
+    /// Store the records and frames of the threads which register from now
+    /// on in a mapping of the file at \p i_path.
+    ///
+    /// \return the mapping, or nullptr if the file could not be mapped.
+    ProfileMapping* Map(const char* i_path)
+    {
+        std::unique_ptr<ProfileMapping> mapping(new ProfileMapping());
+        if (!mapping->Open(i_path, m_recordCapacity, g_nanosecondsPerTick)) {
+            return nullptr;
+        }
+
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        m_mapping = std::move(mapping);
+        return m_mapping.get();
+    }
+
+    /// Stream the records of the threads which register from now on, such
+    /// that they are not overwritten until drained.
+    ///
+    /// Must be called before any thread registers.
+    void SetStreaming() { m_streaming = true; }
+
+    /// Get the calling thread's buffer.
+    ///
+    /// Only the buffer of the most recent container is cached, so threads
+    /// which switch between sessions look their buffer up again upon the
+    /// first region after each switch.
+    ProfileRecordBuffer* GetThreadBuffer()
+    {
+        if (tl_recordBufferGeneration != m_generation) {
+            tl_recordBuffer = RegisterThread();
+            tl_recordBufferGeneration = m_generation;
+        }
+
+        return tl_recordBuffer;
+    }
+
+    /// Get the calling thread's buffer, or nullptr if it has yet to profile
+    /// a region.
+    ProfileRecordBuffer* FindThreadBuffer() const
+    {
+        return tl_recordBufferGeneration == m_generation ? tl_recordBuffer
+                                                          : nullptr;
+    }
+
+    /// Collect the valid records of all the thread buffers into
+    /// \p o_records, along with their performance counter deltas, if
+    /// collected, into \p o_recordCounters.
+    void GatherRecords(std::vector<ProfileRecord>& o_records,
+                       std::vector<ProfileRecordCounters>& o_recordCounters)
+    {
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        for (const std::unique_ptr<ProfileRecordBuffer>& buffer : m_buffers) {
+            uint32_t recordsSize = buffer->GetRecordsSize();
+            const ProfileRecord* records = buffer->GetRecords();
+            o_records.insert(o_records.end(), records, records + recordsSize);
+
+            const ProfileRecordCounters* recordCounters =
+                buffer->GetRecordCounters();
+            if (recordCounters != nullptr) {
+                o_recordCounters.insert(o_recordCounters.end(),
+                                        recordCounters,
+                                        recordCounters + recordsSize);
+            }
+        }
+    }
+
+    /// Collect the valid samples of all the thread buffers into
+    /// \p o_samples.
+    void GatherSamples(std::vector<ProfileSample>& o_samples)
+    {
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        for (const std::unique_ptr<ProfileRecordBuffer>& buffer : m_buffers) {
+            const ProfileSample* samples = buffer->GetSamples();
+            if (samples != nullptr) {
+                o_samples.insert(o_samples.end(),
+                                 samples,
+                                 samples + buffer->GetSamplesSize());
+            }
+        }
+    }
+
+    /// Merge the site statistics of all the thread buffers into \p o_moments,
+    /// and flag the sites which any thread has throttled in \p o_throttled.
+    void GatherStatistics(std::vector<ProfileSiteMoments>& o_moments,
+                          std::vector<bool>& o_throttled)
+    {
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        for (const std::unique_ptr<ProfileRecordBuffer>& buffer : m_buffers) {
+            buffer->GatherStatistics(o_moments, o_throttled);
+        }
+    }
+
+    /// Write the records published since the last drain by all the thread
+    /// buffers to \p io_writer.
+    ///
+    /// \return true if any buffer was at least half full, such that the next
+    /// drain should not be delayed.
+    bool Drain(ProfileTraceWriter& io_writer)
+    {
+        // The lock is not held while writing, so that threads may register
+        // meanwhile.  Buffers live as long as the container.
+        std::vector<ProfileRecordBuffer*> buffers;
+        {
+            const std::lock_guard<std::mutex> lock(m_buffersMutex);
+            for (const std::unique_ptr<ProfileRecordBuffer>& buffer :
+                 m_buffers) {
+                buffers.push_back(buffer.get());
+            }
+        }
+
+        bool busy = false;
+        for (ProfileRecordBuffer* buffer : buffers) {
+            if (buffer->Drain(io_writer) * 2 >= buffer->GetCapacity()) {
+                busy = true;
+            }
+        }
+
+        return busy;
+    }
+
+    /// Get the number of records dropped by all the thread buffers.
+    uint64_t GetDroppedCount()
+    {
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        uint64_t droppedCount = 0;
+        for (const std::unique_ptr<ProfileRecordBuffer>& buffer : m_buffers) {
+            droppedCount += buffer->GetDroppedCount();
+        }
+
+        return droppedCount;
+    }
+
+    /// Write the records and open regions of all the thread buffers, and the
+    /// number of dropped records, with \p io_writer.
+    ///
+    /// Does not lock, for use from signal handlers, so only visits the
+    /// buffers published so far.
+    void WriteCrash(ProfileTraceSignalWriter& io_writer, uint64_t i_stop) const
+    {
+        uint64_t droppedCount = 0;
+        uint32_t bufferCount = m_publishedBuffers.GetSize();
+        for (uint32_t bufferIndex = 0; bufferIndex < bufferCount;
+             ++bufferIndex) {
+            const ProfileRecordBuffer* buffer =
+                m_publishedBuffers.Get(bufferIndex);
+            buffer->WriteCrash(io_writer, i_stop);
+            droppedCount += buffer->GetDroppedCount();
+        }
+        io_writer.WriteDroppedRecordCount(droppedCount);
+    }
+
+    /// Get the number of bytes allocated by all the thread buffers.
+    size_t GetMemoryUsage()
+    {
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        size_t memoryUsage = sizeof(*this);
+        for (const std::unique_ptr<ProfileRecordBuffer>& buffer : m_buffers) {
+            memoryUsage += buffer->GetMemoryUsage();
+        }
+
+        return memoryUsage;
+    }
+
+private:
+    /// Find the buffer the calling thread has registered before, or allocate
+    /// a new one.
+    ProfileRecordBuffer* RegisterThread()
+    {
+        uint64_t threadSerial = _GetThreadSerial();
+        const std::lock_guard<std::mutex> lock(m_buffersMutex);
+        for (size_t bufferIndex = 0; bufferIndex < m_buffers.size();
+             ++bufferIndex) {
+            if (m_bufferThreads[bufferIndex] == threadSerial) {
+                return m_buffers[bufferIndex].get();
+            }
+        }
+
+        m_buffers.emplace_back(new ProfileRecordBuffer(
+            m_recordCapacity, m_buffers.size(), m_mapping.get(), m_streaming));
+        m_bufferThreads.push_back(threadSerial);
+        if (g_profilerCounters) {
+            m_buffers.back()->OpenCounters(g_profilerCounterSet);
+        }
+        m_publishedBuffers.Append(m_buffers.back().get());
+        _InstallSignalStack();
+        return m_buffers.back().get();
+    }
+
+    /// Number of records allocated per thread.
+    uint32_t m_recordCapacity = 0;
+
+    /// Are records streamed to a trace file?
+    bool m_streaming = false;
+
+    /// Unique identifier of this container instance.
+    uint64_t m_generation = 0;
+
+    /// Guards registration of thread buffers.
+    std::mutex m_buffersMutex;
+
+    /// Storage of the records, if mapped.  Outlives the buffers.
+    std::unique_ptr<ProfileMapping> m_mapping;
+
+    /// Per-thread record buffers.
+    std::vector<std::unique_ptr<ProfileRecordBuffer>> m_buffers;
+
+    /// Serial number of the thread owning each buffer of \ref m_buffers.
+    std::vector<uint64_t> m_bufferThreads;
+
+    /// Per-thread record buffers, for readers which cannot lock.
+    ProfilePublishedArray<ProfileRecordBuffer> m_publishedBuffers;
+};
 
-/// \class ProfileRecord
+/// \class ProfileRecordDrain
 ///
-/// A single timed record of executed code.
-class alignas(128) ProfileRecord
+/// Background thread which periodically streams the records of every thread
+/// buffer of a container into a trace file, for continuous capture.
+class ProfileRecordDrain final
 {
 public:
-    void Print() const
+    explicit ProfileRecordDrain(ProfileRecordContainer* i_container)
+      : m_container(i_container)
     {
-        timespec duration = _ComputeDuration(m_start, m_stop);
-        uint32_t microseconds =
-            (uint32_t)(duration.tv_sec * 1e6 + duration.tv_nsec / 1e3);
+    }
+
+    ~ProfileRecordDrain() = default;
+
+    /// Cannot copy.
+    ProfileRecordDrain(const ProfileRecordDrain&) = delete;
+    ProfileRecordDrain& operator=(const ProfileRecordDrain&) = delete;
 
-        std::stringstream ss;
-        for (uint32_t stackIndex = 0; stackIndex < m_stack; ++stackIndex) {
-            ss << " ";
+    /// Open the trace file at \p i_path and start draining.
+    ///
+    /// \return false if the file could not be opened.
+    bool Start(const char* i_path)
+    {
+        if (!m_writer.Open(i_path, g_nanosecondsPerTick)) {
+            return false;
         }
-        ss << "\\_";
 
-        printf("%s User-string: '%s', line: %u, stack: %u, duration: %u us\n",
-               ss.str().c_str(),
-               m_string,
-               m_line,
-               m_stack,
-               microseconds);
+        g_profilerDraining.store(true, std::memory_order_release);
+        m_thread = std::thread(&ProfileRecordDrain::Run, this);
+        return true;
     }
 
-    // Members.
-    char m_string[c_profileRecordStringCapacity]; // 80 bytes
-    timespec m_start = { 0, 0 };                  // 96 bytes
-    timespec m_stop = { 0, 0 };                   // 112 bytes
-    uint32_t m_line = 0;                          // 116 bytes
-    uint32_t m_stack = 0;                         // 120 bytes
-    std::thread::id m_threadId;                   // 128 bytes
-};
+    /// Stop draining, stream the remaining records, then complete the trace
+    /// with the sites and statistics of \p i_summary.
+    ///
+    /// \return false if the trace could not be written.
+    bool Stop(const ProfileCapture& i_summary)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_one();
+        m_thread.join();
 
-static_assert(sizeof(ProfileRecord) == 128, "ProfileRecord must be 128 bytes in size");
+        // Release the stalled threads, whose records are dropped from now on.
+        g_profilerDraining.store(false, std::memory_order_release);
+        m_container->Drain(m_writer);
+        m_writer.WriteSummary(i_summary);
+        return m_writer.Close();
+    }
 
-/// Singleton store of profile records.
-class ProfileRecordContainer final
-{
-public:
-    ProfileRecordContainer(uint32_t i_recordCapacity)
+private:
+    /// Bounds of the period between drains.
+    static constexpr std::chrono::microseconds c_minDrainPeriod{ 50 };
+    static constexpr std::chrono::microseconds c_maxDrainPeriod{ 10000 };
+
+    /// Drain periodically until stopped, more often while the buffers fill
+    /// up quickly.
+    void Run()
     {
-        m_records.resize(i_recordCapacity);
+        std::chrono::microseconds period = c_maxDrainPeriod;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_condition.wait_for(
+            lock, period, [this] { return m_stopping; })) {
+            lock.unlock();
+            if (m_container->Drain(m_writer)) {
+                period = std::max(period / 2, c_minDrainPeriod);
+            } else {
+                period = std::min(period * 2, c_maxDrainPeriod);
+            }
+            lock.lock();
+        }
     }
 
-    ~ProfileRecordContainer() = default;
+    ProfileRecordContainer* m_container = nullptr;
+    ProfileTraceWriter m_writer;
+    std::thread m_thread;
 
-    /// Cannot copy.
-    ProfileRecordContainer(const ProfileRecordContainer&) = delete;
-    ProfileRecordContainer& operator=(const ProfileRecordContainer&) = delete;
+    /// Guards \ref m_stopping, and wakes the drain thread when stopping.
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+};
 
-    /// Check out the next record to author timing and metadata into.
-    ProfileRecord* Checkout()
-    {
-        int index = m_recordIndex.fetch_add(1, std::memory_order_relaxed);
-        if (index >= m_records.size()) {
-            m_recordsLoopAround = true;
+constexpr std::chrono::microseconds ProfileRecordDrain::c_minDrainPeriod;
+constexpr std::chrono::microseconds ProfileRecordDrain::c_maxDrainPeriod;
 
-            // Only one of the threads should be resetting the index back to 0,
-            // unless enough threads accumulate and loop around twice!
-            if (index == m_records.size()) {
-                m_recordIndex.store(0);
-            }
+/// Container of the profiler set up by \ref ProfilerSetup.
+static ProfileRecordContainer* g_recordContainer = nullptr;
+
+/// Drain of the set-up container, in continuous capture.
+static ProfileRecordDrain* g_recordDrain = nullptr;
+
+/// Global mutex to guard setup and teardown of store, and the selection of
+/// the global session.
+static std::mutex g_recordContainerMutex;
+
+/// Container of the session made global, if any.
+static ProfileRecordContainer* g_globalSessionContainer = nullptr;
 
-            // Make sure we don't step out of bounds for all profiles which
-            // enter this if clause.
-            index = index % m_records.size();
+/// Container which the threads without a current session record into: that
+/// of the global session if any, or else the set-up container.
+static std::atomic<ProfileRecordContainer*> g_globalContainer{ nullptr };
+
+/// Container of the session made current on the calling thread, if any.
+static thread_local ProfileRecordContainer* tl_sessionContainer = nullptr;
+
+// Get the container which the calling thread records into, or nullptr if
+// there is none.
+static ProfileRecordContainer* _GetCurrentContainer()
+{
+    ProfileRecordContainer* container = tl_sessionContainer;
+    return container != nullptr
+               ? container
+               : g_globalContainer.load(std::memory_order_acquire);
+}
+
+// Point g_globalContainer at the global session, or at the set-up container.
+//
+// g_recordContainerMutex must be held.
+static void _UpdateGlobalContainer()
+{
+    g_globalContainer.store(g_globalSessionContainer != nullptr
+                                ? g_globalSessionContainer
+                                : g_recordContainer,
+                            std::memory_order_release);
+}
+
+#if EULER_PROFILER_HAS_SIGNALS
+
+/// Fatal signals upon which the profiler writes a crash trace.
+static const int c_crashSignals[] = { SIGABRT, SIGSEGV, SIGFPE };
+
+/// Number of fatal signals upon which the profiler writes a crash trace.
+constexpr size_t c_crashSignalCount =
+    sizeof(c_crashSignals) / sizeof(c_crashSignals[0]);
+
+/// Handlers of the fatal signals before the profiler was set up.
+static struct sigaction g_previousCrashActions[c_crashSignalCount];
+
+/// Path of the crash trace, or empty if fatal signals are not handled.
+static std::string g_crashPath;
+
+/// Set by the first fatal signal, so that only one crash trace is written.
+static std::atomic_flag g_crashHandled = ATOMIC_FLAG_INIT;
+
+/// Writer of the crash trace, in static storage as the stack of the crashing
+/// thread may be exhausted.
+static ProfileTraceSignalWriter g_crashWriter;
+
+// Restore the handlers of the fatal signals from before the profiler was set
+// up.
+static void _RestoreCrashHandlers()
+{
+    for (size_t signalIndex = 0; signalIndex < c_crashSignalCount;
+         ++signalIndex) {
+        sigaction(c_crashSignals[signalIndex],
+                  &g_previousCrashActions[signalIndex],
+                  nullptr);
+    }
+}
+
+// Write the crash trace, then let the previous handler of \p i_signal
+// terminate the process.
+//
+// Only async-signal-safe functions are called, and no lock is taken, so the
+// other threads keep profiling while their records are written out.
+static void _HandleCrash(int i_signal)
+{
+    if (!g_crashHandled.test_and_set()) {
+        const ProfileRecordContainer* container = g_recordContainer;
+        if (container != nullptr &&
+            g_crashWriter.Open(g_crashPath.c_str(), g_nanosecondsPerTick)) {
+            // Sites are written last, to name those which the other threads
+            // register in the meantime.  Only the sites and buffers which are
+            // published are visited, as their vectors may be reallocating.
+            container->WriteCrash(g_crashWriter, _ReadStopTimestamp());
+            ProfileSiteRegistry::Get().WriteSites(g_crashWriter);
+            g_crashWriter.Close();
         }
+    }
+
+    // The signal is raised again once this handler returns, or the faulting
+    // instruction is retried.
+    _RestoreCrashHandlers();
+    raise(i_signal);
+}
+
+// Write a crash trace to \p i_path upon fatal signals.
+static void _InstallCrashHandlers(const char* i_path)
+{
+    g_crashPath = i_path;
 
-        return &m_records[index];
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _HandleCrash;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_ONSTACK;
+    for (size_t signalIndex = 0; signalIndex < c_crashSignalCount;
+         ++signalIndex) {
+        sigaction(c_crashSignals[signalIndex],
+                  &action,
+                  &g_previousCrashActions[signalIndex]);
     }
 
-    /// Return a reference to the records.
-    const std::vector<ProfileRecord>& GetRecords() const { return m_records; }
+    // Threads install their alternate stack as they register.
+    g_crashHandlersInstalled.store(true, std::memory_order_relaxed);
+    _InstallSignalStack();
+}
 
-    /// Get the size of the records.
-    uint32_t GetRecordsSize() const
+// Stop writing crash traces upon fatal signals.
+static void _UninstallCrashHandlers()
+{
+    if (!g_crashPath.empty()) {
+        g_crashHandlersInstalled.store(false, std::memory_order_relaxed);
+        _RestoreCrashHandlers();
+        g_crashPath.clear();
+    }
+}
+
+#else
+
+static void _InstallCrashHandlers(const char* i_path)
+{
+}
+
+static void _UninstallCrashHandlers()
+{
+}
+
+#endif
+
+/// \class ProfileCalibrationScope
+///
+/// Profiles its lifetime like \ref ScopedProfiler, regardless of the filter.
+class ProfileCalibrationScope final : public Profiler
+{
+public:
+    explicit ProfileCalibrationScope(const ProfileSite& i_site)
     {
-        if (m_recordsLoopAround.load()) {
-            // If we have reached capacity at some point, then all records are
-            // valid.
-            return m_records.size();
-        } else {
-            int index = m_recordIndex.load();
-            // There is a chance that we reach capacity between the:
-            // m_recordsLoopAround.load()
-            // and
-            // m_recordIndex.load()
-            // So make sure we return a size value.
-            return index < m_records.size() ? index : m_records.size();
+        Attach(i_site);
+        Start();
+    }
+
+    ~ProfileCalibrationScope()
+    {
+        if (IsAttached()) {
+            Stop();
         }
     }
+};
 
-private:
-    /// Current record index.
-    std::atomic_int m_recordIndex{ 0 };
+/// Number of rounds of empty regions profiled by the calibration, of which
+/// the fastest is retained.
+constexpr uint32_t c_calibrationRoundCount = 16;
 
-    /// Have each record been authored at least once?
-    std::atomic_bool m_recordsLoopAround{ false };
+/// Number of empty regions profiled in each round of the calibration.
+constexpr uint32_t c_calibrationRegionCount = 1024;
 
-    /// Allocated records.
-    std::vector<ProfileRecord> m_records;
-};
+// Measure the overhead of profiling a region on the calling thread, with the
+// current options, into g_scopeOverheadTicks and g_nestingOverheadTicks.
+//
+// The empty regions are recorded into a container of their own, made
+// current on the calling thread, such that they are not reported.
+// g_recordContainerMutex must be held, and the profiler must not be set up.
+static void _CalibrateOverhead()
+{
+    static const ProfileSite s_site(__FILE__, __LINE__, "ProfilerCalibration");
 
-/// Singleton pointer.
-static ProfileRecordContainer* g_recordContainer = nullptr;
+    // Every region is recorded, as otherwise the rounds would time the
+    // cheaper paths of the skipped and throttled regions.
+    uint32_t sampleRate = g_profilerSampleRate;
+    g_profilerSampleRate = 1;
+    uint64_t throttleWindowLimit = g_throttleWindowLimit;
+    g_throttleWindowLimit = 0;
+    ProfileRecordContainer container(c_calibrationRegionCount);
+    ProfileRecordContainer* sessionContainer = tl_sessionContainer;
+    tl_sessionContainer = &container;
 
-/// Global mutex to guard setup and teardown of store.
-static std::mutex g_recordContainerMutex;
+    // The enclosing region is charged for the whole of the cost of each
+    // enclosed region, as timed around it.
+    uint64_t nestingTicks = UINT64_MAX;
+    for (uint32_t roundIndex = 0; roundIndex < c_calibrationRoundCount;
+         ++roundIndex) {
+        uint64_t start = _ReadStopTimestamp();
+        for (uint32_t regionIndex = 0; regionIndex < c_calibrationRegionCount;
+             ++regionIndex) {
+            ProfileCalibrationScope scope(s_site);
+        }
+        uint64_t stop = _ReadStopTimestamp();
+        nestingTicks = std::min(nestingTicks,
+                                (stop - start) / c_calibrationRegionCount);
+    }
+
+    // The region itself only measures the share of the cost between its
+    // timestamps, of which the median of the last round is retained.  The
+    // container holds one round of records, so only the last one is left.
+    std::vector<ProfileRecord> records;
+    std::vector<ProfileRecordCounters> recordCounters;
+    container.GatherRecords(records, recordCounters);
+    std::vector<uint64_t> scopeTicks;
+    for (const ProfileRecord& record : records) {
+        scopeTicks.push_back(record.m_stop - record.m_start);
+    }
+    if (!scopeTicks.empty()) {
+        std::nth_element(scopeTicks.begin(),
+                         scopeTicks.begin() + scopeTicks.size() / 2,
+                         scopeTicks.end());
+        g_scopeOverheadTicks =
+            std::min(scopeTicks[scopeTicks.size() / 2], nestingTicks);
+        g_nestingOverheadTicks = nestingTicks;
+        g_calibrationRegionCount = (uint32_t)scopeTicks.size();
+    }
+
+    tl_sessionContainer = sessionContainer;
+    g_throttleWindowLimit = throttleWindowLimit;
+    g_profilerSampleRate = sampleRate;
+}
+
+// Snapshot everything but the records of \p io_container into \p o_capture.
+//
+// g_recordContainerMutex must be held.
+static void _CaptureSummary(ProfileRecordContainer& io_container,
+                            ProfileCapture& o_capture)
+{
+    o_capture.m_nanosecondsPerTick = g_nanosecondsPerTick;
+    ProfileSiteRegistry::Get().GatherSites(o_capture.m_sites);
+
+    std::vector<ProfileSiteMoments> moments(o_capture.m_sites.size());
+    std::vector<bool> throttled(o_capture.m_sites.size());
+    io_container.GatherStatistics(moments, throttled);
+    o_capture.m_siteStatistics.resize(o_capture.m_sites.size());
+    for (size_t siteIndex = 0; siteIndex < o_capture.m_sites.size();
+         ++siteIndex) {
+        o_capture.m_sites[siteIndex].m_throttled = throttled[siteIndex];
+        o_capture.m_siteStatistics[siteIndex] =
+            moments[siteIndex].GetStatistics(
+                g_nanosecondsPerTick,
+                o_capture.m_sites[siteIndex].m_sampleRate);
+    }
 
-void ProfilerSetup(uint32_t i_capacity)
+    o_capture.m_droppedRecordCount = io_container.GetDroppedCount();
+    o_capture.m_cpuTime = g_profilerCpuTime;
+    o_capture.m_allocations = g_profilerAllocations;
+    o_capture.m_scopeOverheadNanoseconds =
+        (double)g_scopeOverheadTicks * g_nanosecondsPerTick;
+    o_capture.m_nestingOverheadNanoseconds =
+        (double)g_nestingOverheadTicks * g_nanosecondsPerTick;
+    o_capture.m_calibrationRegionCount = g_calibrationRegionCount;
+    if (g_profilerCounters) {
+        ProfileCounterGroup::GetNames(g_profilerCounterSet,
+                                      o_capture.m_counterNames);
+    }
+}
+
+// Snapshot \p io_container into \p o_capture.
+//
+// g_recordContainerMutex must be held.
+static void _Capture(ProfileRecordContainer& io_container,
+                     ProfileCapture& o_capture)
+{
+    // Sites are gathered last, as the other threads may register sites
+    // meanwhile, such that the site of every record and sample is known.
+    o_capture.m_records.clear();
+    o_capture.m_recordCounters.clear();
+    io_container.GatherRecords(o_capture.m_records,
+                               o_capture.m_recordCounters);
+    o_capture.m_samples.clear();
+    io_container.GatherSamples(o_capture.m_samples);
+    _CaptureSummary(io_container, o_capture);
+    ProfileCaptureSortRecords(o_capture);
+}
+
+void ProfilerSetup(const ProfilerOptions& i_options)
 {
     const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
     if (g_recordContainer == nullptr) {
-        g_recordContainer = new ProfileRecordContainer(i_capacity);
+        if (i_options.m_clock == ProfilerClock::TSC && _HasInvariantTSC()) {
+            g_profilerClock = ProfilerClock::TSC;
+            g_nanosecondsPerTick = _CalibrateTSC();
+        } else {
+            g_profilerClock = ProfilerClock::Monotonic;
+            g_nanosecondsPerTick = 1.0;
+        }
+
+        g_profilerSampleRate = std::max(i_options.m_sampleRate, 1u);
+        g_throttleWindowTicks =
+            (uint64_t)(c_throttleWindowNanoseconds / g_nanosecondsPerTick);
+        g_throttleWindowLimit =
+            std::max<uint64_t>((uint64_t)i_options.m_throttleCallRate *
+                                   c_throttleWindowNanoseconds / 1000000000,
+                               i_options.m_throttleCallRate != 0 ? 1 : 0);
+        ProfilerSetCategoryMask(i_options.m_categoryMask);
+
+        g_profilerCpuTime = i_options.m_cpuTime;
+
+        const char* allocations = getenv("EULER_PROFILE_ALLOCATIONS");
+        g_profilerAllocations = allocations != nullptr
+                                    ? atoi(allocations) != 0
+                                    : i_options.m_allocations;
+
+        // The hardware counters are probed on the calling thread, assuming
+        // that the other threads are alike.
+        g_profilerCounters = false;
+        if (i_options.m_counters) {
+            ProfileCounterGroup counterGroup;
+            if (counterGroup.Open(ProfileCounterSet::Hardware)) {
+                g_profilerCounterSet = ProfileCounterSet::Hardware;
+                g_profilerCounters = true;
+            } else if (counterGroup.Open(ProfileCounterSet::Software)) {
+                g_profilerCounterSet = ProfileCounterSet::Software;
+                g_profilerCounters = true;
+            }
+        }
+
+        const char* filter = getenv("EULER_PROFILE_FILTER");
+        ProfileSiteRegistry::Get().SetFilter(filter != nullptr
+                                                 ? filter
+                                                 : i_options.m_filter);
+
+        // Calibrated once every other option is in effect, as they add to
+        // the overhead.
+        g_scopeOverheadTicks = 0;
+        g_nestingOverheadTicks = 0;
+        g_calibrationRegionCount = 0;
+        if (i_options.m_calibrateOverhead) {
+            _CalibrateOverhead();
+        }
+
+        // The container is only published once complete, as threads may
+        // register as soon as it is.
+        g_profilerOverflow = i_options.m_streamOverflow;
+        ProfileRecordContainer* container =
+            new ProfileRecordContainer(i_options.m_capacity);
+        if (i_options.m_mappedPath != nullptr) {
+            ProfileSiteRegistry::Get().SetMapping(
+                container->Map(i_options.m_mappedPath));
+        }
+
+        if (i_options.m_streamPath != nullptr) {
+            g_recordDrain = new ProfileRecordDrain(container);
+            if (g_recordDrain->Start(i_options.m_streamPath)) {
+                container->SetStreaming();
+            } else {
+                delete g_recordDrain;
+                g_recordDrain = nullptr;
+            }
+        }
+
+        // Crash handlers are installed ahead, such that every thread which
+        // registers installs its alternate signal stack.
+        if (i_options.m_crashPath != nullptr) {
+            _InstallCrashHandlers(i_options.m_crashPath);
+        }
+        g_recordContainer = container;
+        _UpdateGlobalContainer();
     }
 }
 
+void ProfilerSetup(uint32_t i_capacity, ProfilerClock i_clock)
+{
+    ProfilerOptions options;
+    options.m_capacity = i_capacity;
+    options.m_clock = i_clock;
+    ProfilerSetup(options);
+}
+
+ProfilerClock ProfilerGetClock()
+{
+    return g_profilerClock;
+}
+
+void ProfilerSetCategoryMask(uint32_t i_mask)
+{
+    g_profilerCategoryMask.store(i_mask, std::memory_order_relaxed);
+}
+
+uint32_t ProfilerGetCategoryMask()
+{
+    return g_profilerCategoryMask.load(std::memory_order_relaxed);
+}
+
 void ProfilerTeardown()
 {
     const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
+    if (g_recordDrain != nullptr) {
+        ProfileCapture summary;
+        _CaptureSummary(*g_recordContainer, summary);
+        g_recordDrain->Stop(summary);
+        delete g_recordDrain;
+        g_recordDrain = nullptr;
+    }
+
     if (g_recordContainer != nullptr) {
-        delete g_recordContainer;
+        _UninstallCrashHandlers();
+        ProfileSiteRegistry::Get().SetMapping(nullptr);
+        ProfileRecordContainer* container = g_recordContainer;
         g_recordContainer = nullptr;
+        _UpdateGlobalContainer();
+        delete container;
     }
 }
 
-void ProfilerPrint()
+size_t ProfilerGetMemoryUsage()
+{
+    const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
+    if (g_recordContainer == nullptr) {
+        return 0;
+    }
+
+    return g_recordContainer->GetMemoryUsage();
+}
+
+bool ProfilerCapture(ProfileCapture& o_capture)
 {
     const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
     if (g_recordContainer == nullptr) {
+        return false;
+    }
+
+    _Capture(*g_recordContainer, o_capture);
+    return true;
+}
+
+void ProfilerTrackAllocation(size_t i_bytes)
+{
+    if (g_profilerAllocations && !tl_profilerAllocating) {
+        ProfileRecordContainer* container = _GetCurrentContainer();
+        ProfileRecordBuffer* buffer =
+            container != nullptr ? container->FindThreadBuffer() : nullptr;
+        if (buffer != nullptr) {
+            buffer->AddAllocation((int64_t)i_bytes);
+        }
+    }
+}
+
+void ProfilerTrackDeallocation(size_t i_bytes)
+{
+    if (g_profilerAllocations && !tl_profilerAllocating) {
+        ProfileRecordContainer* container = _GetCurrentContainer();
+        ProfileRecordBuffer* buffer =
+            container != nullptr ? container->FindThreadBuffer() : nullptr;
+        if (buffer != nullptr) {
+            buffer->AddAllocation(-(int64_t)i_bytes);
+        }
+    }
+}
+
+// Complete \p io_sample with the current time, and record it on the calling
+// thread.
+static void _RecordSample(ProfileSample& io_sample)
+{
+    ProfileRecordContainer* container = _GetCurrentContainer();
+    if (container == nullptr) {
         return;
     }
 
-    uint32_t recordsSize = g_recordContainer->GetRecordsSize();
-    std::vector<ProfileRecord> records = g_recordContainer->GetRecords();
-    std::sort(records.begin(),
-              records.begin() + recordsSize,
-              [](const ProfileRecord& a, const ProfileRecord& b) {
-                  if (a.m_start.tv_sec == b.m_start.tv_sec) {
-                      return a.m_start.tv_nsec < b.m_start.tv_nsec;
-                  } else {
-                      return a.m_start.tv_sec < b.m_start.tv_sec;
-                  }
-              });
+    io_sample.m_time = _ReadStartTimestamp();
+    container->GetThreadBuffer()->AddSample(io_sample);
+}
 
-    printf("=== Profiler Timings ===\n");
-    for (uint32_t recordIndex = 0; recordIndex < recordsSize; ++recordIndex) {
-        records[recordIndex].Print();
+void ProfilerRecordCounter(const ProfileSite& i_site, int64_t i_value)
+{
+    if (i_site.IsEnabled()) {
+        ProfileSample sample;
+        sample.m_site = i_site.GetId();
+        sample.m_kind = ProfileSampleKind::Counter;
+        sample.m_counter = i_value;
+        _RecordSample(sample);
     }
 }
 
-Profiler::Profiler(const char* i_file, uint32_t i_line, const char* i_string)
+void ProfilerRecordGauge(const ProfileSite& i_site, double i_value)
 {
-    if (g_recordContainer != nullptr) {
-        m_profileRecord = g_recordContainer->Checkout();
-        m_profileRecord->m_line = i_line;
-        m_profileRecord->m_threadId = std::this_thread::get_id();
-        strncpy(
-            m_profileRecord->m_string, i_string, c_profileRecordStringCapacity);
+    if (i_site.IsEnabled()) {
+        ProfileSample sample;
+        sample.m_site = i_site.GetId();
+        sample.m_kind = ProfileSampleKind::Gauge;
+        sample.m_gauge = i_value;
+        _RecordSample(sample);
     }
 }
 
-/// Thread-local global variable for tracking stack position of profile records.
-static thread_local uint32_t tl_profileStack = 0;
+void ProfilerAsyncBegin(const ProfileSite& i_site, uint64_t i_id)
+{
+    if (i_site.IsEnabled()) {
+        ProfileSample sample;
+        sample.m_site = i_site.GetId();
+        sample.m_kind = ProfileSampleKind::AsyncBegin;
+        sample.m_asyncId = i_id;
+        _RecordSample(sample);
+    }
+}
 
-void Profiler::Start()
+void ProfilerAsyncEnd(uint64_t i_id)
+{
+    ProfileSample sample;
+    sample.m_kind = ProfileSampleKind::AsyncEnd;
+    sample.m_asyncId = i_id;
+    _RecordSample(sample);
+}
+
+void ProfilerPrint()
 {
-    if (m_profileRecord != nullptr) {
-        m_profileRecord->m_stack = tl_profileStack++;
-        clock_gettime(CLOCK_MONOTONIC, &(m_profileRecord->m_start));
+    ProfileCapture capture;
+    if (ProfilerCapture(capture)) {
+        ProfileCapturePrint(capture);
     }
 }
 
-void Profiler::Stop()
+void ProfilerPrintStatistics()
+{
+    ProfileCapture capture;
+    if (ProfilerCapture(capture)) {
+        ProfileCapturePrintStatistics(capture);
+    }
+}
+
+bool ProfilerExportChromeTrace(const char* i_path)
+{
+    ProfileCapture capture;
+    if (!ProfilerCapture(capture)) {
+        return false;
+    }
+
+    return ProfileCaptureExportChromeTrace(capture, i_path);
+}
+
+bool ProfilerExportTrace(const char* i_path)
+{
+    ProfileCapture capture;
+    if (!ProfilerCapture(capture)) {
+        return false;
+    }
+
+    return ProfileCaptureExportTrace(capture, i_path);
+}
+
+bool ProfilerExportFoldedStacks(const char* i_path)
+{
+    ProfileCapture capture;
+    if (!ProfilerCapture(capture)) {
+        return false;
+    }
+
+    return ProfileCaptureExportFoldedStacks(capture, i_path);
+}
+
+ProfilerSession::ProfilerSession(uint32_t i_capacity)
+  : m_container(new ProfileRecordContainer(i_capacity))
+{
+}
+
+ProfilerSession::~ProfilerSession()
+{
+    if (tl_sessionContainer == m_container) {
+        tl_sessionContainer = nullptr;
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
+        if (g_globalSessionContainer == m_container) {
+            g_globalSessionContainer = nullptr;
+            _UpdateGlobalContainer();
+        }
+    }
+
+    delete m_container;
+}
+
+void ProfilerSession::MakeCurrent()
+{
+    tl_sessionContainer = m_container;
+}
+
+void ProfilerSession::ClearCurrent()
+{
+    tl_sessionContainer = nullptr;
+}
+
+void ProfilerSession::MakeGlobal()
+{
+    const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
+    g_globalSessionContainer = m_container;
+    _UpdateGlobalContainer();
+}
+
+void ProfilerSession::ClearGlobal()
+{
+    const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
+    g_globalSessionContainer = nullptr;
+    _UpdateGlobalContainer();
+}
+
+void ProfilerSession::Capture(ProfileCapture& o_capture)
+{
+    // The lock keeps the options of the profiler from changing meanwhile.
+    const std::lock_guard<std::mutex> lock(g_recordContainerMutex);
+    _Capture(*m_container, o_capture);
+}
+
+size_t ProfilerSession::GetMemoryUsage()
+{
+    return m_container->GetMemoryUsage();
+}
+
+void ProfilerSession::Print()
+{
+    ProfileCapture capture;
+    Capture(capture);
+    ProfileCapturePrint(capture);
+}
+
+void ProfilerSession::PrintStatistics()
 {
-    if (m_profileRecord != nullptr) {
-        clock_gettime(CLOCK_MONOTONIC, &(m_profileRecord->m_stop));
-        tl_profileStack--;
+    ProfileCapture capture;
+    Capture(capture);
+    ProfileCapturePrintStatistics(capture);
+}
+
+bool ProfilerSession::ExportChromeTrace(const char* i_path)
+{
+    ProfileCapture capture;
+    Capture(capture);
+    return ProfileCaptureExportChromeTrace(capture, i_path);
+}
+
+bool ProfilerSession::ExportTrace(const char* i_path)
+{
+    ProfileCapture capture;
+    Capture(capture);
+    return ProfileCaptureExportTrace(capture, i_path);
+}
+
+bool ProfilerSession::ExportFoldedStacks(const char* i_path)
+{
+    ProfileCapture capture;
+    Capture(capture);
+    return ProfileCaptureExportFoldedStacks(capture, i_path);
+}
+
+Profiler::Profiler(const ProfileSite& i_site)
+{
+    if (i_site.IsEnabled()) {
+        Attach(i_site);
+    }
+}
+
+void Profiler::Attach(const ProfileSite& i_site)
+{
+    ProfileRecordContainer* container = _GetCurrentContainer();
+    if (container == nullptr) {
+        return;
+    }
+
+    ProfileRecordBuffer* buffer = container->GetThreadBuffer();
+    m_site = i_site.GetId();
+    m_sampleRate = _GetSampleRate(i_site);
+
+    // Sites with their own rate are sampled inline by SampledScopedProfiler.
+    if (i_site.GetSampleRate() == 0 && m_sampleRate > 1 &&
+        !buffer->Sample(m_site, m_sampleRate)) {
+        return;
+    }
+
+    m_buffer = buffer;
+}
+
+void Profiler::AttachSampled(const ProfileSite& i_site, uint32_t& io_countdown)
+{
+    // Sites which follow the rate of the options are sampled by Attach()
+    // instead, per thread buffer.
+    if (i_site.GetSampleRate() != 0) {
+        io_countdown = _DrawSampleInterval(i_site.GetSampleRate());
     }
+    Attach(i_site);
 }
 
-ScopedProfiler::ScopedProfiler(const char* i_file,
-                               uint32_t i_line,
-                               const char* i_string)
-  : Profiler(i_file, i_line, i_string)
+void Profiler::Start()
 {
-    Start();
+    if (m_buffer != nullptr) {
+        ProfileFrame* frame = m_buffer->PushFrame(m_site, m_sampleRate);
+        if (frame == nullptr) {
+            m_buffer = nullptr;
+            return;
+        }
+
+        frame->m_start = _ReadStartTimestamp();
+        m_buffer->StartCpuTime();
+    }
 }
 
-ScopedProfiler::~ScopedProfiler()
+void Profiler::Stop()
 {
-    Stop();
+    if (m_buffer != nullptr) {
+        uint64_t cpuStop = m_buffer->StopCpuTime();
+        m_buffer->PopFrame(_ReadStopTimestamp(), cpuStop);
+    }
 }
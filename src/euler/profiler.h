@@ -28,52 +28,269 @@
 /// \endcode
 
 #include <euler/api.h>
+
+#include <atomic>
+#include <stddef.h>
 #include <stdint.h>
 
+/// \def EULER_ENABLE_PROFILING
+///
+/// Set to 0 to compile all the profiling macros below into nothing, such that
+/// instrumented code carries no profiling overhead whatsoever.  Controlled by
+/// the EULER_ENABLE_PROFILING CMake option.
+#if !defined(EULER_ENABLE_PROFILING)
+#    define EULER_ENABLE_PROFILING 1
+#endif
+
+#if EULER_ENABLE_PROFILING
+
 /// \def PROFILER_SETUP
 ///
 /// Allocate the memory required for profiling.
-#define PROFILER_SETUP() ProfilerSetup();
+#    define PROFILER_SETUP() ProfilerSetup();
 
-#define _SCOPED_PROFILE(file, line, string)                                    \
-    ScopedProfiler profile##line(file, line, string);
+#    define _SCOPED_PROFILE(file, line, string)                                \
+        static const ProfileSite profileSite##line(file, line, string);        \
+        ScopedProfiler profile##line(profileSite##line);
 
 /// \def PROFILE
 ///
 /// Insert a scoped profiler tagged with a user-supplied string.
-#define PROFILE(string) _SCOPED_PROFILE(__FILE__, __LINE__, string)
+#    define PROFILE(string) _SCOPED_PROFILE(__FILE__, __LINE__, string)
 
 /// \def PROFILE_FUNCTION
 ///
 /// Insert a scoped profiler tagged with the pretty-function interpretation
 /// of the parent function.
-#define PROFILE_FUNCTION()                                                     \
-    _SCOPED_PROFILE(__FILE__, __LINE__, __PRETTY_FUNCTION__)
+#    define PROFILE_FUNCTION()                                                 \
+        _SCOPED_PROFILE(__FILE__, __LINE__, __PRETTY_FUNCTION__)
+
+#    define _SAMPLED_SCOPED_PROFILE(file, line, string, rate)                  \
+        static const ProfileSite profileSite##line(file, line, string, rate);  \
+        static thread_local uint32_t profileCountdown##line = 0;               \
+        SampledScopedProfiler profile##line(profileSite##line,                 \
+                                            profileCountdown##line);
+
+/// \def PROFILE_SAMPLED
+///
+/// Insert a scoped profiler tagged with a user-supplied string, which only
+/// profiles 1 in every \p rate entries on each thread, on average.  The
+/// statistics of the site are scaled back up by \p rate.  A \p rate of 0
+/// follows the rate of \ref ProfilerOptions.
+///
+/// Skipped entries only cost the decrement of a thread-local counter.
+#    define PROFILE_SAMPLED(string, rate)                                      \
+        _SAMPLED_SCOPED_PROFILE(__FILE__, __LINE__, string, rate)
+
+#    define _CATEGORY_SCOPED_PROFILE(file, line, category, string)             \
+        static const ProfileSite profileSite##line(file, line, string);        \
+        CategoryScopedProfiler profile##line(profileSite##line, category);
+
+/// \def PROFILE_CAT
+///
+/// Insert a scoped profiler tagged with a user-supplied string, which only
+/// profiles while any bit of \p category is set in the category mask (\ref
+/// ProfilerSetCategoryMask).
+///
+/// Categories are user-defined bit masks, for example:
+/// \code{.cpp}
+/// constexpr uint32_t CAT_SIEVE = 1u << 0;
+///
+/// PROFILE_CAT(CAT_SIEVE, "MarkComposites");
+/// \endcode
+#    define PROFILE_CAT(category, string)                                      \
+        _CATEGORY_SCOPED_PROFILE(__FILE__, __LINE__, category, string)
+
+/// \def PROFILE_FUNCTION_CAT
+///
+/// Similar to \ref PROFILE_FUNCTION, but only profiles while any bit of
+/// \p category is set in the category mask.
+#    define PROFILE_FUNCTION_CAT(category)                                     \
+        _CATEGORY_SCOPED_PROFILE(                                              \
+            __FILE__, __LINE__, category, __PRETTY_FUNCTION__)
+
+// Samples are recorded within a block of their own, as the site need not
+// outlive the statement, which is a single statement such that the macro may
+// be followed by a semicolon, even as the body of an if-else.
+#    define _PROFILE_SAMPLE(file, line, string, function, value)               \
+        do {                                                                   \
+            static const ProfileSite profileSite##line(file, line, string);    \
+            function(profileSite##line, value);                                \
+        } while (0)
+
+/// \def PROFILE_COUNTER
+///
+/// Record the current \p value, an integer, of the counter track named by
+/// \p string, for example the number of candidates tried so far.
+///
+/// Samples are timed like profiled regions, and exported as counter tracks
+/// alongside them.
+#    define PROFILE_COUNTER(string, value)                                     \
+        _PROFILE_SAMPLE(                                                       \
+            __FILE__, __LINE__, string, ProfilerRecordCounter, value)
+
+/// \def PROFILE_GAUGE
+///
+/// Record the current \p value, a floating-point number, of the gauge track
+/// named by \p string.
+#    define PROFILE_GAUGE(string, value)                                       \
+        _PROFILE_SAMPLE(__FILE__, __LINE__, string, ProfilerRecordGauge, value)
+
+/// \def PROFILE_ASYNC_BEGIN
+///
+/// Begin an asynchronous span named by \p string, identified by \p id, which
+/// may end on another thread, for example as work is queued for a pool.
+///
+/// Identifiers must be unique among the spans in flight, and may be reused
+/// once their span has ended.
+#    define PROFILE_ASYNC_BEGIN(string, id)                                    \
+        _PROFILE_SAMPLE(__FILE__, __LINE__, string, ProfilerAsyncBegin, id)
+
+/// \def PROFILE_ASYNC_END
+///
+/// End the asynchronous span identified by \p id, on any thread.
+///
+/// Exports link the profiled region enclosing the beginning of the span to
+/// the one enclosing its end, so ending the span within the region which
+/// consumes the work separates its queueing from its execution.
+#    define PROFILE_ASYNC_END(id) ProfilerAsyncEnd(id)
+
+/// \def PROFILER_SET_CATEGORY_MASK
+///
+/// Only profile the categorized sites which share a bit with \p mask.
+#    define PROFILER_SET_CATEGORY_MASK(mask) ProfilerSetCategoryMask(mask);
 
 /// \def PROFILER_TEARDOWN
 ///
 /// Free all the memory allocated for profiling.
-#define PROFILER_TEARDOWN() ProfilerTeardown();
+#    define PROFILER_TEARDOWN() ProfilerTeardown();
 
 /// \def PROFILER_PRINT
 ///
 /// Pretty-print all the profiled timings in a human-readable form.
-#define PROFILER_PRINT() ProfilerPrint();
+#    define PROFILER_PRINT() ProfilerPrint();
+
+/// \def PROFILER_PRINT_STATISTICS
+///
+/// Pretty-print the aggregate timings of each profiled call site.
+#    define PROFILER_PRINT_STATISTICS() ProfilerPrintStatistics();
+
+/// \def PROFILER_EXPORT_CHROME_TRACE
+///
+/// Write all the profiled timings to \p path in the Chrome Trace Event Format.
+#    define PROFILER_EXPORT_CHROME_TRACE(path) ProfilerExportChromeTrace(path);
+
+/// \def PROFILER_EXPORT_TRACE
+///
+/// Write all the profiled timings to \p path in the compact binary trace
+/// format, for analysis with euler-trace.
+#    define PROFILER_EXPORT_TRACE(path) ProfilerExportTrace(path);
+
+/// \def PROFILER_EXPORT_FOLDED_STACKS
+///
+/// Write all the profiled timings to \p path as folded stacks.
+#    define PROFILER_EXPORT_FOLDED_STACKS(path)                                \
+        ProfilerExportFoldedStacks(path);
+
+#else
+
+#    define PROFILER_SETUP()
+#    define PROFILE(string)
+#    define PROFILE_FUNCTION()
+#    define PROFILE_SAMPLED(string, rate)
+#    define PROFILE_CAT(category, string)
+#    define PROFILE_FUNCTION_CAT(category)
+#    define PROFILE_COUNTER(string, value)                                     \
+        do {                                                                   \
+        } while (0)
+#    define PROFILE_GAUGE(string, value)                                       \
+        do {                                                                   \
+        } while (0)
+#    define PROFILE_ASYNC_BEGIN(string, id)                                    \
+        do {                                                                   \
+        } while (0)
+#    define PROFILE_ASYNC_END(id)                                              \
+        do {                                                                   \
+        } while (0)
+#    define PROFILER_SET_CATEGORY_MASK(mask)
+#    define PROFILER_TEARDOWN()
+#    define PROFILER_PRINT()
+#    define PROFILER_PRINT_STATISTICS()
+#    define PROFILER_EXPORT_CHROME_TRACE(path)
+#    define PROFILER_EXPORT_TRACE(path)
+#    define PROFILER_EXPORT_FOLDED_STACKS(path)
+
+#endif
 
 /// Fwd declaration.
-class ProfileRecord;
+class ProfileCapture;
+class ProfileRecordBuffer;
+class ProfileRecordContainer;
+class ProfileSiteRegistry;
 
-/// \class Profiler
+/// \class ProfileSite
 ///
-/// Records the timing on Start() and Stop().
+/// Static description of a profiled call site.
 ///
-/// It also records call site information and a user supplied string.
+/// The profile macros declare each site as a function-local static, so it is
+/// registered once and profile records only need to store its identifier.
+/// The strings are not copied, and must outlive the site.
+class EULER_API ProfileSite final
+{
+public:
+    /// \param i_sampleRate profile 1 in every \p i_sampleRate entries of
+    /// this site, or 0 to follow the rate of \ref ProfilerOptions.
+    explicit ProfileSite(const char* i_file,
+                         uint32_t i_line,
+                         const char* i_name,
+                         uint32_t i_sampleRate = 0);
+    ~ProfileSite() = default;
+
+    // Cannot be copied.
+    ProfileSite(const ProfileSite& i_site) = delete;
+    ProfileSite& operator=(const ProfileSite& i_site) = delete;
+
+    /// Get the unique identifier assigned to this site upon registration.
+    uint32_t GetId() const { return m_id; }
+
+    /// Get the source file of this site.
+    const char* GetFile() const { return m_file; }
+
+    /// Get the source line of this site.
+    uint32_t GetLine() const { return m_line; }
+
+    /// Get the user-supplied name of this site.
+    const char* GetName() const { return m_name; }
+
+    /// Get the sampling rate of this site, or 0 if it follows the rate of
+    /// \ref ProfilerOptions.
+    uint32_t GetSampleRate() const { return m_sampleRate; }
+
+    /// Is this site selected by the filter of \ref ProfilerOptions?
+    ///
+    /// The filter is matched once, when the site is registered or the
+    /// profiler is set up, such that disabled sites only cost this load.
+    bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+private:
+    const char* m_file = nullptr;
+    uint32_t m_line = 0;
+    const char* m_name = nullptr;
+    uint32_t m_sampleRate = 0;
+    uint32_t m_id = 0;
+
+    // Sites are static constants, but their selection follows the filter.
+    friend class ProfileSiteRegistry;
+    mutable std::atomic_bool m_enabled{ true };
+};
+
+/// \class Profiler
+///
+/// Records the timing on Start() and Stop(), attributed to a call site.
 class EULER_API Profiler
 {
 public:
-    explicit Profiler(const char* i_file,
-                      uint32_t i_line,
-                      const char* i_string);
+    explicit Profiler(const ProfileSite& i_site);
     ~Profiler() = default;
 
     // Cannot be copied.
@@ -86,11 +303,36 @@ public:
     /// Record the ending time.
     void Stop();
 
+protected:
+    /// Construct a profiler which does not record anything until Attach().
+    Profiler() = default;
+
+    /// Attach to the calling thread's buffer, to record regions of
+    /// \p i_site.  Does nothing if the profiler has not been set up and no
+    /// session is current, or if this entry of \p i_site is skipped by
+    /// sampling.
+    void Attach(const ProfileSite& i_site);
+
+    /// Attach to the calling thread's buffer, to record the current sampled
+    /// entry of \p i_site, and reset \p io_countdown to the number of entries
+    /// to skip until the next sample.
+    void AttachSampled(const ProfileSite& i_site, uint32_t& io_countdown);
+
+    /// Has this profiler been attached to a buffer?
+    bool IsAttached() const { return m_buffer != nullptr; }
+
 private:
-    /// The profile record to author timings and metadata into.
+    /// The calling thread's buffer, which tracks the open region between
+    /// Start() and Stop() and authors its record.
     /// This memory is not owned by the Profiler instance itself, but by the
-    /// internal global record store.
-    ProfileRecord* m_profileRecord = nullptr;
+    /// record store of the session current upon Attach().
+    ProfileRecordBuffer* m_buffer = nullptr;
+
+    /// Identifier of the profiled call site.
+    uint32_t m_site = 0;
+
+    /// Sampling rate of the profiled call site.
+    uint32_t m_sampleRate = 1;
 };
 
 /// \class ScopedProfiler
@@ -100,28 +342,440 @@ private:
 class EULER_API ScopedProfiler final : public Profiler
 {
 public:
-    explicit ScopedProfiler(const char* i_file,
-                            uint32_t i_line,
-                            const char* i_string);
-    ~ScopedProfiler();
+    explicit ScopedProfiler(const ProfileSite& i_site)
+    {
+        if (!i_site.IsEnabled()) {
+            return;
+        }
+
+        Attach(i_site);
+        Start();
+    }
+
+    ~ScopedProfiler()
+    {
+        if (IsAttached()) {
+            Stop();
+        }
+    }
 
     // Cannot be copied.
     ScopedProfiler(const ScopedProfiler& i_profile) = delete;
     ScopedProfiler& operator=(const ScopedProfiler& i_profile) = delete;
 };
 
+/// \class SampledScopedProfiler
+///
+/// Similar to \ref ScopedProfiler, but only profiles 1 in every
+/// \ref ProfileSite::GetSampleRate() entries on average, counted down by
+/// \p io_countdown.
+///
+/// Entries which are skipped are decided inline, without calling into the
+/// profiler.
+class SampledScopedProfiler final : public Profiler
+{
+public:
+    explicit SampledScopedProfiler(const ProfileSite& i_site,
+                                   uint32_t& io_countdown)
+    {
+        if (!i_site.IsEnabled()) {
+            return;
+        } else if (io_countdown != 0) {
+            --io_countdown;
+            return;
+        }
+
+        AttachSampled(i_site, io_countdown);
+        Start();
+    }
+
+    ~SampledScopedProfiler()
+    {
+        if (IsAttached()) {
+            Stop();
+        }
+    }
+
+    // Cannot be copied.
+    SampledScopedProfiler(const SampledScopedProfiler& i_profile) = delete;
+    SampledScopedProfiler& operator=(const SampledScopedProfiler& i_profile) =
+        delete;
+};
+
+/// Mask of the categories of \ref PROFILE_CAT sites which are profiled.
+///
+/// Read inline by \ref CategoryScopedProfiler, such that disabled categories
+/// only cost a load and a branch.  Set through \ref ProfilerSetCategoryMask.
+EULER_API
+extern std::atomic<uint32_t> g_profilerCategoryMask;
+
+/// \class CategoryScopedProfiler
+///
+/// Similar to \ref ScopedProfiler, but only profiles while any bit of
+/// \p i_category is set in the category mask.
+class CategoryScopedProfiler final : public Profiler
+{
+public:
+    explicit CategoryScopedProfiler(const ProfileSite& i_site,
+                                    uint32_t i_category)
+    {
+        if ((g_profilerCategoryMask.load(std::memory_order_relaxed) &
+             i_category) == 0 ||
+            !i_site.IsEnabled()) {
+            return;
+        }
+
+        Attach(i_site);
+        Start();
+    }
+
+    ~CategoryScopedProfiler()
+    {
+        if (IsAttached()) {
+            Stop();
+        }
+    }
+
+    // Cannot be copied.
+    CategoryScopedProfiler(const CategoryScopedProfiler& i_profile) = delete;
+    CategoryScopedProfiler&
+    operator=(const CategoryScopedProfiler& i_profile) = delete;
+};
+
+/// \enum ProfilerClock
+///
+/// Source of the timestamps recorded at the start and stop of each profile.
+enum class ProfilerClock : uint8_t
+{
+    /// clock_gettime(CLOCK_MONOTONIC).  Available everywhere.
+    Monotonic,
+
+    /// The invariant time-stamp counter, read with rdtsc / rdtscp.
+    ///
+    /// Ticks are calibrated against CLOCK_MONOTONIC during setup, and only
+    /// converted to nanoseconds upon reporting.  Falls back to \ref Monotonic
+    /// if the processor does not provide an invariant time-stamp counter.
+    TSC,
+};
+
+/// \enum ProfilerOverflow
+///
+/// Behavior of profiled threads whose records have not been drained in time,
+/// in continuous capture (\ref ProfilerOptions::m_streamPath).
+enum class ProfilerOverflow : uint8_t
+{
+    /// Drop the new records, which are counted and reported.
+    Drop,
+
+    /// Stall the profiled thread until the drain catches up.
+    Stall,
+};
+
+/// \class ProfilerOptions
+///
+/// Configuration of the profiler, applied by \ref ProfilerSetup.
+class ProfilerOptions
+{
+public:
+    /// Number of records to allocate for each profiled thread.  If the number
+    /// of profile instances on a thread exceed this number, it will loop back
+    /// to the thread's initial record (oldest records will begin to be
+    /// overwritten).
+    uint32_t m_capacity = 10000;
+
+    /// The requested timestamp source.
+    ProfilerClock m_clock = ProfilerClock::Monotonic;
+
+    /// Only profile 1 in every \p m_sampleRate entries of each call site on
+    /// each thread, on average, except for sites with their own rate (\ref
+    /// PROFILE_SAMPLED).  The statistics of sampled sites are scaled back up.
+    uint32_t m_sampleRate = 1;
+
+    /// Maximum number of records per second each call site may author on each
+    /// thread, measured over 10 millisecond windows, or 0 to disable.
+    ///
+    /// Sites which exceed this rate within a window are throttled: they stop
+    /// authoring records, and only contribute to the statistics, so that a
+    /// forgotten profile in an inner loop cannot overwrite the records of
+    /// coarser regions.  They author records again once a whole window stays
+    /// within the rate.  Throttling is disabled by default, such that every
+    /// region is recorded.
+    uint32_t m_throttleCallRate = 0;
+
+    /// Mask of the categories of \ref PROFILE_CAT sites to profile.  All
+    /// categories are profiled by default.
+    uint32_t m_categoryMask = ~0u;
+
+    /// Only profile the call sites whose name matches this filter, or all of
+    /// them if null or empty.
+    ///
+    /// The filter is a '|'-separated list of glob patterns, where '*' matches
+    /// any sequence of characters and '?' any single character, each of which
+    /// may match anywhere within the name, for example "isPrime|Compute*".
+    ///
+    /// The EULER_PROFILE_FILTER environment variable, when set, takes
+    /// precedence over this filter.
+    const char* m_filter = nullptr;
+
+    /// Stream all the records to a trace file at this path, to be read back
+    /// with \ref ProfileTraceRead, or keep only the most recent records of
+    /// each thread in memory if null.
+    ///
+    /// In this continuous capture mode, a background thread periodically
+    /// drains the record buffers to the file, so \p m_capacity only needs to
+    /// absorb the records authored between drains.  The trace is completed
+    /// upon \ref ProfilerTeardown.  Falls back to the in-memory mode if the
+    /// file cannot be opened.
+    const char* m_streamPath = nullptr;
+
+    /// Behavior of the profiled threads whose record buffer is full of
+    /// records which have yet to be drained.
+    ProfilerOverflow m_streamOverflow = ProfilerOverflow::Drop;
+
+    /// Store the records and open regions of each thread in a shared mapping
+    /// of the file at this path, rather than on the heap, if not null.
+    ///
+    /// The operating system preserves the file when the process crashes, and
+    /// \ref ProfileMappingRead or euler-trace rebuild the timeline from it,
+    /// including the regions which never closed.  Recording still only
+    /// performs plain stores.  Falls back to the heap if the file cannot be
+    /// mapped.  Only supported on POSIX systems.
+    const char* m_mappedPath = nullptr;
+
+    /// Write the records, along with the regions open on each thread, to a
+    /// trace at this path when the process receives SIGABRT, SIGSEGV or
+    /// SIGFPE, which includes failed \ref ASSERT "ASSERT"s, if not null.
+    ///
+    /// The trace is written with async-signal-safe calls only, while the
+    /// other threads keep running, so records authored concurrently may be
+    /// torn.  Open regions are closed at the time of the signal.  Profiled
+    /// threads handle the signal on an alternate stack, such that stack
+    /// overflows are traced too.  Only supported on POSIX systems.
+    const char* m_crashPath = nullptr;
+
+    /// Collect performance counters over each profiled region, through a
+    /// perf_event_open(2) group per thread.
+    ///
+    /// Hardware counters are collected when the PMU is available, and
+    /// software counters otherwise, as in most virtual machines.  The deltas
+    /// are kept alongside each record, and totalled per site.  Reading the
+    /// counters costs a system call at both ends of each region.  Only
+    /// supported on Linux.
+    bool m_counters = false;
+
+    /// Measure the CPU time of each profiled region, with
+    /// CLOCK_THREAD_CPUTIME_ID, alongside its wall time.
+    ///
+    /// Reports then split the time of each site between CPU time and
+    /// off-CPU time, spent descheduled or blocked.  Reading the clock costs
+    /// a system call at both ends of each region.
+    bool m_cpuTime = false;
+
+    /// Attribute the heap allocations of each thread to its innermost open
+    /// region, overridden by the EULER_PROFILE_ALLOCATIONS environment
+    /// variable if set.
+    ///
+    /// Reports then show the number of allocations and bytes allocated
+    /// directly within each site, and the peak of its live bytes.  Requires
+    /// the library to be built with EULER_ENABLE_ALLOCATION_TRACKING, or
+    /// allocations to be reported through \ref ProfilerTrackAllocation.
+    bool m_allocations = false;
+
+    /// Measure the overhead of the profiler on the calling thread at setup,
+    /// by profiling empty regions, and subtract it from the statistics.
+    ///
+    /// Part of the cost of profiling a region falls between its timestamps,
+    /// and the whole of it within its enclosing region, which skews the
+    /// timings of short regions.  Durations are then corrected by the former
+    /// for every region, and self times by the latter for every enclosed
+    /// region, such that sub-microsecond regions report realistic times.
+    /// Records keep their measured timestamps.
+    bool m_calibrateOverhead = false;
+};
+
 /// Allocate memory used for profiling.
+EULER_API
+void ProfilerSetup(const ProfilerOptions& i_options);
+
+/// Allocate memory used for profiling.
+///
+/// \param i_capacity number of records to allocate for each profiled thread.
+/// \param i_clock the requested timestamp source.
 ///
-/// \param i_capacity total number of records to allocate.  If the number of
-/// profile instances exceed this number, it will loop back to the initial
-/// record (oldest records will begin to be overwritten).
+/// \sa ProfilerOptions
 EULER_API
-void ProfilerSetup(uint32_t i_capacity = 10000);
+void ProfilerSetup(uint32_t i_capacity = 10000,
+                   ProfilerClock i_clock = ProfilerClock::Monotonic);
+
+/// Get the timestamp source which is in effect, which may differ from the
+/// clock requested in \ref ProfilerSetup if it is not supported.
+EULER_API
+ProfilerClock ProfilerGetClock();
+
+/// Only profile the \ref PROFILE_CAT sites whose category shares a bit with
+/// \p i_mask.  May be called at any time, from any thread.
+EULER_API
+void ProfilerSetCategoryMask(uint32_t i_mask);
+
+/// Get the mask of the categories which are profiled.
+EULER_API
+uint32_t ProfilerGetCategoryMask();
 
 /// Deallocate memory used for profiling.
 EULER_API
 void ProfilerTeardown();
 
+/// Get the number of bytes currently allocated for profiling.
+EULER_API
+size_t ProfilerGetMemoryUsage();
+
+/// Record \p i_value as the current value of the counter track of \p i_site,
+/// on the calling thread, into its current session (\ref ProfilerSession).
+/// Does nothing if the profiler has not been set up and no session is
+/// current, or if \p i_site is disabled by the filter.
+EULER_API
+void ProfilerRecordCounter(const ProfileSite& i_site, int64_t i_value);
+
+/// Record \p i_value as the current value of the gauge track of \p i_site,
+/// on the calling thread.
+///
+/// \sa ProfilerRecordCounter
+EULER_API
+void ProfilerRecordGauge(const ProfileSite& i_site, double i_value);
+
+/// Begin an asynchronous span of \p i_site, identified by \p i_id, on the
+/// calling thread.  Does nothing if the profiler has not been set up and no
+/// session is current, or if \p i_site is disabled by the filter.
+///
+/// Spans are recorded alongside the samples of the tracks, and reports
+/// measure the time from their beginning to their end.
+EULER_API
+void ProfilerAsyncBegin(const ProfileSite& i_site, uint64_t i_id);
+
+/// End the asynchronous span identified by \p i_id, on the calling thread,
+/// which may differ from the thread that began it.
+EULER_API
+void ProfilerAsyncEnd(uint64_t i_id);
+
 /// Print all profiled records.
 EULER_API
 void ProfilerPrint();
+
+/// Print the aggregate statistics of each profiled call site.
+EULER_API
+void ProfilerPrintStatistics();
+
+/// Write all profiled records to \p i_path in the Chrome Trace Event Format,
+/// for viewing in Perfetto or chrome://tracing.
+///
+/// \return false if the profiler has not been set up, or the file could not be
+/// written.
+EULER_API
+bool ProfilerExportChromeTrace(const char* i_path);
+
+/// Write all profiled records to \p i_path in the binary trace format, to be
+/// read back with \ref ProfileTraceRead or the euler-trace tool.
+///
+/// \return false if the profiler has not been set up, or the file could not be
+/// written.
+EULER_API
+bool ProfilerExportTrace(const char* i_path);
+
+/// Write all profiled records to \p i_path as folded stacks, weighted by
+/// nanoseconds, for rendering with flamegraph.pl or speedscope.
+///
+/// \return false if the profiler has not been set up, or the file could not be
+/// written.
+EULER_API
+bool ProfilerExportFoldedStacks(const char* i_path);
+
+/// \class ProfilerSession
+///
+/// Independent store of profiled records, samples and statistics, for
+/// isolated captures of a unit of work, such as a test case, a request or a
+/// benchmark repetition.
+///
+/// The profile macros record into the session current on the calling thread,
+/// or else into the global session, or else into the profiler set up by
+/// \ref ProfilerSetup.  Sessions follow the clock, sampling, filter and other
+/// options of the latest \ref ProfilerSetup, if any, but keep their records
+/// in memory only.
+///
+/// For example, to profile work items in parallel without mixing their
+/// records:
+/// \code{.cpp}
+/// void processItem(const Item& item) {
+///     ProfilerSession session;
+///     session.MakeCurrent();
+///     doWork(item);
+///     ProfilerSession::ClearCurrent();
+///     session.ExportChromeTrace(item.tracePath);
+/// }
+/// \endcode
+class EULER_API ProfilerSession final
+{
+public:
+    /// \param i_capacity number of records to allocate for each profiled
+    /// thread.
+    explicit ProfilerSession(uint32_t i_capacity = 10000);
+
+    /// Stop recording into this session on the calling thread, and globally.
+    /// Other threads on which the session is current must clear it first.
+    ~ProfilerSession();
+
+    // Cannot be copied.
+    ProfilerSession(const ProfilerSession& i_session) = delete;
+    ProfilerSession& operator=(const ProfilerSession& i_session) = delete;
+
+    /// Record the regions and samples of the calling thread into this
+    /// session, until another session is made current on it or
+    /// ClearCurrent().
+    ///
+    /// Regions which are open meanwhile are recorded into the session they
+    /// were opened in.
+    void MakeCurrent();
+
+    /// Record the calling thread into the global session again.
+    static void ClearCurrent();
+
+    /// Record the threads without a current session into this session,
+    /// rather than into the profiler set up by \ref ProfilerSetup, until
+    /// another session is made global or ClearGlobal().
+    void MakeGlobal();
+
+    /// Record the threads without a current session into the profiler set up
+    /// by \ref ProfilerSetup again.
+    static void ClearGlobal();
+
+    /// Snapshot the records of this session into \p o_capture.
+    void Capture(ProfileCapture& o_capture);
+
+    /// Get the number of bytes currently allocated by this session.
+    size_t GetMemoryUsage();
+
+    /// Print all the records of this session.
+    void Print();
+
+    /// Print the aggregate statistics of each call site of this session.
+    void PrintStatistics();
+
+    /// Write all the records of this session to \p i_path in the Chrome Trace
+    /// Event Format.
+    ///
+    /// \return false if the file could not be written.
+    bool ExportChromeTrace(const char* i_path);
+
+    /// Write all the records of this session to \p i_path in the binary
+    /// trace format.
+    ///
+    /// \return false if the file could not be written.
+    bool ExportTrace(const char* i_path);
+
+    /// Write all the records of this session to \p i_path as folded stacks.
+    ///
+    /// \return false if the file could not be written.
+    bool ExportFoldedStacks(const char* i_path);
+
+private:
+    ProfileRecordContainer* m_container = nullptr;
+};
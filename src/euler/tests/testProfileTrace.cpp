@@ -0,0 +1,301 @@
+/// Round-trips of profile captures through the binary trace format.
+
+#define CATCH_CONFIG_MAIN
+
+// The signal handlers of the bundled Catch2 do not compile against recent
+// glibc, whose MINSIGSTKSZ is not a constant.
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include <catch2/catch.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <euler/profileCapture.h>
+#include <euler/profileTrace.h>
+
+/// Path of the trace written by each test, in the working directory.
+static const char* c_tracePath = "testProfileTrace.trace";
+
+/// Build a record of \p i_site on \p i_thread.
+ProfileRecord MakeRecord(uint64_t i_start,
+                         uint64_t i_stop,
+                         uint32_t i_site,
+                         uint16_t i_stack,
+                         uint16_t i_thread,
+                         uint32_t i_id,
+                         uint32_t i_parent)
+{
+    ProfileRecord record;
+    record.m_start = i_start;
+    record.m_stop = i_stop;
+    record.m_site = i_site;
+    record.m_stack = i_stack;
+    record.m_thread = i_thread;
+    record.m_id = i_id;
+    record.m_parent = i_parent;
+    return record;
+}
+
+/// Build a sample of \p i_kind of \p i_site on \p i_thread.
+ProfileSample MakeSample(uint64_t i_time,
+                         ProfileSampleKind i_kind,
+                         uint32_t i_site,
+                         uint16_t i_thread)
+{
+    ProfileSample sample;
+    sample.m_time = i_time;
+    sample.m_kind = i_kind;
+    sample.m_site = i_site;
+    sample.m_thread = i_thread;
+    return sample;
+}
+
+/// Add a site to \p io_capture.
+void AddSite(ProfileCapture& io_capture,
+             const char* i_file,
+             uint32_t i_line,
+             const char* i_name)
+{
+    ProfileCaptureSite site;
+    site.m_file = i_file;
+    site.m_line = i_line;
+    site.m_name = i_name;
+    io_capture.m_sites.push_back(site);
+    io_capture.m_siteStatistics.emplace_back();
+}
+
+/// Check that \p i_actual holds the same records as \p i_expected.
+void CheckRecords(const std::vector<ProfileRecord>& i_actual,
+                  const std::vector<ProfileRecord>& i_expected)
+{
+    REQUIRE(i_actual.size() == i_expected.size());
+    for (size_t recordIndex = 0; recordIndex < i_expected.size();
+         ++recordIndex) {
+        const ProfileRecord& actual = i_actual[recordIndex];
+        const ProfileRecord& expected = i_expected[recordIndex];
+        CHECK(actual.m_start == expected.m_start);
+        CHECK(actual.m_stop == expected.m_stop);
+        CHECK(actual.m_site == expected.m_site);
+        CHECK(actual.m_stack == expected.m_stack);
+        CHECK(actual.m_thread == expected.m_thread);
+        CHECK(actual.m_id == expected.m_id);
+        CHECK(actual.m_parent == expected.m_parent);
+    }
+}
+
+TEST_CASE("ExportTrace")
+{
+    ProfileCapture capture;
+    capture.m_nanosecondsPerTick = 0.25;
+    AddSite(capture, "main.cpp", 12, "Outer");
+    AddSite(capture, "main.cpp", 34, "Inner");
+    AddSite(capture, "main.cpp", 56, "Track");
+    capture.m_sites[1].m_sampleRate = 8;
+    capture.m_sites[1].m_throttled = true;
+    capture.m_siteStatistics[0].m_count = 1;
+    capture.m_siteStatistics[0].m_totalNanoseconds = 250;
+    capture.m_siteStatistics[0].m_meanNanoseconds = 250.0;
+    capture.m_siteStatistics[0].m_cpuNanoseconds = 200;
+    capture.m_siteStatistics[1].m_allocationCount = 3;
+    capture.m_siteStatistics[1].m_allocatedBytes = 96;
+    capture.m_siteStatistics[1].m_peakLiveBytes = 64;
+    capture.m_siteStatistics[1].m_counterTotals[1] = 12345;
+    capture.m_droppedRecordCount = 7;
+    capture.m_cpuTime = true;
+    capture.m_allocations = true;
+    capture.m_counterNames = { "cycles", "instructions" };
+    capture.m_scopeOverheadNanoseconds = 12.5;
+    capture.m_nestingOverheadNanoseconds = 20.0;
+    capture.m_calibrationRegionCount = 1024;
+
+    // Starts go backwards across threads, and stops far beyond starts, to
+    // exercise the signed and relative encodings.
+    capture.m_records = {
+        MakeRecord(1000, 2000, 0, 0, 0, 1, 0),
+        MakeRecord(1100, 1200, 1, 1, 0, 2, 1),
+        MakeRecord(1300, 1900, 1, 1, 0, 3, 1),
+        MakeRecord(500, UINT64_MAX / 2, 0, 0, 3, 70000, 0),
+    };
+
+    capture.m_samples = {
+        MakeSample(1050, ProfileSampleKind::Counter, 2, 0),
+        MakeSample(1150, ProfileSampleKind::Gauge, 2, 0),
+        MakeSample(1160, ProfileSampleKind::AsyncBegin, 2, 0),
+        MakeSample(1700, ProfileSampleKind::AsyncEnd, 0, 3),
+    };
+    capture.m_samples[0].m_counter = -42;
+    capture.m_samples[1].m_gauge = 0.5;
+    capture.m_samples[2].m_asyncId = UINT64_MAX;
+    capture.m_samples[3].m_asyncId = UINT64_MAX;
+    ProfileCaptureSortRecords(capture);
+
+    REQUIRE(ProfileCaptureExportTrace(capture, c_tracePath));
+    ProfileCapture readCapture;
+    REQUIRE(ProfileTraceRead(c_tracePath, readCapture));
+
+    CHECK(readCapture.m_nanosecondsPerTick == capture.m_nanosecondsPerTick);
+    CHECK(readCapture.m_droppedRecordCount == 7);
+    CHECK(readCapture.m_cpuTime);
+    CHECK(readCapture.m_allocations);
+    CHECK(readCapture.m_counterNames == capture.m_counterNames);
+    CHECK(readCapture.m_scopeOverheadNanoseconds == 12.5);
+    CHECK(readCapture.m_nestingOverheadNanoseconds == 20.0);
+    CHECK(readCapture.m_calibrationRegionCount == 1024);
+
+    REQUIRE(readCapture.m_sites.size() == capture.m_sites.size());
+    for (size_t siteIndex = 0; siteIndex < capture.m_sites.size();
+         ++siteIndex) {
+        const ProfileCaptureSite& actual = readCapture.m_sites[siteIndex];
+        const ProfileCaptureSite& expected = capture.m_sites[siteIndex];
+        CHECK(actual.m_file == expected.m_file);
+        CHECK(actual.m_line == expected.m_line);
+        CHECK(actual.m_name == expected.m_name);
+        CHECK(actual.m_sampleRate == expected.m_sampleRate);
+        CHECK(actual.m_throttled == expected.m_throttled);
+    }
+
+    REQUIRE(readCapture.m_siteStatistics.size() == 3);
+    CHECK(readCapture.m_siteStatistics[0].m_count == 1);
+    CHECK(readCapture.m_siteStatistics[0].m_totalNanoseconds == 250);
+    CHECK(readCapture.m_siteStatistics[0].m_meanNanoseconds == 250.0);
+    CHECK(readCapture.m_siteStatistics[0].m_cpuNanoseconds == 200);
+    CHECK(readCapture.m_siteStatistics[1].m_allocationCount == 3);
+    CHECK(readCapture.m_siteStatistics[1].m_allocatedBytes == 96);
+    CHECK(readCapture.m_siteStatistics[1].m_peakLiveBytes == 64);
+    CHECK(readCapture.m_siteStatistics[1].m_counterTotals[1] == 12345);
+
+    CheckRecords(readCapture.m_records, capture.m_records);
+
+    REQUIRE(readCapture.m_samples.size() == capture.m_samples.size());
+    for (size_t sampleIndex = 0; sampleIndex < capture.m_samples.size();
+         ++sampleIndex) {
+        const ProfileSample& actual = readCapture.m_samples[sampleIndex];
+        const ProfileSample& expected = capture.m_samples[sampleIndex];
+        CHECK(actual.m_time == expected.m_time);
+        CHECK(actual.m_kind == expected.m_kind);
+        CHECK(actual.m_thread == expected.m_thread);
+        if (expected.m_kind != ProfileSampleKind::AsyncEnd) {
+            CHECK(actual.m_site == expected.m_site);
+        }
+        if (expected.IsAsync()) {
+            CHECK(actual.m_asyncId == expected.m_asyncId);
+        } else {
+            CHECK(actual.GetValue() == expected.GetValue());
+        }
+    }
+
+    remove(c_tracePath);
+}
+
+TEST_CASE("SignalWriterTrace")
+{
+    // Crash traces name their sites last, and hold the regions which were
+    // still open, closed at the time of the crash.
+    std::vector<ProfileRecord> records = {
+        MakeRecord(10, 20, 1, 1, 0, 2, 1),
+    };
+    std::vector<ProfileRecord> openRecords = {
+        MakeRecord(5, 30, 0, 0, 0, 1, 0),
+        MakeRecord(25, 30, 1, 1, 0, 3, 1),
+    };
+    ProfileSample sample = MakeSample(15, ProfileSampleKind::Counter, 1, 0);
+    sample.m_counter = 3;
+
+    ProfileTraceSignalWriter writer;
+    REQUIRE(writer.Open(c_tracePath, 1.0));
+    writer.WriteRecords(0, records.data(), records.size());
+    writer.WriteOpenRecords(0, openRecords.data(), openRecords.size());
+    writer.WriteSamples(0, &sample, 1);
+    writer.WriteDroppedRecordCount(2);
+    writer.WriteSite("crash.cpp", 1, "Outer", 1);
+    writer.WriteSite("crash.cpp", 2, "Inner", 1);
+    writer.Close();
+
+    ProfileCapture capture;
+    REQUIRE(ProfileTraceRead(c_tracePath, capture));
+    REQUIRE(capture.m_sites.size() == 2);
+    CHECK(capture.m_sites[0].m_name == "Outer");
+    CHECK(capture.m_sites[1].m_name == "Inner");
+    CHECK(capture.m_droppedRecordCount == 2);
+
+    CheckRecords(capture.m_openRecords, openRecords);
+    CheckRecords(capture.m_records,
+                 { openRecords[0], records[0], openRecords[1] });
+
+    REQUIRE(capture.m_samples.size() == 1);
+    CHECK(capture.m_samples[0].m_time == 15);
+    CHECK(capture.m_samples[0].m_counter == 3);
+
+    // Statistics are computed from the records, as crash traces have none.
+    REQUIRE(capture.m_siteStatistics.size() == 2);
+    CHECK(capture.m_siteStatistics[0].m_count == 1);
+    CHECK(capture.m_siteStatistics[1].m_count == 2);
+
+    remove(c_tracePath);
+}
+
+TEST_CASE("DamagedTrace")
+{
+    // Write a trace, then replace its end marker, its last 12 bytes, by a
+    // block which declares more bytes than the file holds.
+    ProfileRecord record = MakeRecord(1, 2, 0, 0, 0, 1, 0);
+    ProfileTraceWriter writer;
+    REQUIRE(writer.Open(c_tracePath, 1.0));
+    writer.WriteRecords(0, &record, 1);
+    REQUIRE(writer.Close());
+
+    std::vector<char> bytes;
+    FILE* file = fopen(c_tracePath, "rb");
+    REQUIRE(file != nullptr);
+    char byte;
+    while (fread(&byte, 1, 1, file) == 1) {
+        bytes.push_back(byte);
+    }
+    fclose(file);
+
+    const char tag[4] = { 'R', 'E', 'C', 'S' };
+    uint64_t size = 1ull << 62;
+    REQUIRE(bytes.size() > 12);
+    bytes.resize(bytes.size() - 12);
+    bytes.insert(bytes.end(), tag, tag + sizeof(tag));
+    bytes.insert(bytes.end(),
+                 (const char*)&size,
+                 (const char*)&size + sizeof(size));
+    file = fopen(c_tracePath, "wb");
+    REQUIRE(file != nullptr);
+    fwrite(bytes.data(), bytes.size(), 1, file);
+    fclose(file);
+
+    // The damaged block is treated as the truncation of the trace.
+    ProfileCapture capture;
+    CHECK(ProfileTraceRead(c_tracePath, capture));
+    CHECK(capture.m_records.size() == 1);
+
+    remove(c_tracePath);
+}
+
+TEST_CASE("OtherVersion")
+{
+    // Traces of any other version than the current one are rejected.
+    ProfileRecord record = MakeRecord(1, 2, 0, 0, 0, 1, 0);
+    for (uint32_t version :
+         { c_profileTraceVersion - 1, c_profileTraceVersion + 1 }) {
+        ProfileTraceWriter writer;
+        REQUIRE(writer.Open(c_tracePath, 1.0));
+        writer.WriteRecords(0, &record, 1);
+        REQUIRE(writer.Close());
+
+        // The version follows the 8 bytes of the magic.
+        FILE* file = fopen(c_tracePath, "r+b");
+        REQUIRE(file != nullptr);
+        fseek(file, 8, SEEK_SET);
+        fwrite(&version, sizeof(version), 1, file);
+        fclose(file);
+
+        ProfileCapture capture;
+        CHECK_FALSE(ProfileTraceRead(c_tracePath, capture));
+    }
+
+    remove(c_tracePath);
+}
@@ -0,0 +1,135 @@
+/// Measurements of the profiler, recorded into sessions.
+
+#define CATCH_CONFIG_MAIN
+
+// The signal handlers of the bundled Catch2 do not compile against recent
+// glibc, whose MINSIGSTKSZ is not a constant.
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include <catch2/catch.hpp>
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <euler/profileCapture.h>
+#include <euler/profiler.h>
+
+/// Number of regions profiled by each test.
+constexpr uint32_t c_regionCount = 1000;
+
+/// Return the index of the site named \p i_name in \p i_capture.
+size_t FindSite(const ProfileCapture& i_capture, const char* i_name)
+{
+    for (size_t siteIndex = 0; siteIndex < i_capture.m_sites.size();
+         ++siteIndex) {
+        if (i_capture.m_sites[siteIndex].m_name == i_name) {
+            return siteIndex;
+        }
+    }
+
+    FAIL("No site named " << i_name);
+    return 0;
+}
+
+/// Keep the calling thread on the CPU for \p i_microseconds.
+void Spin(uint32_t i_microseconds)
+{
+    std::chrono::steady_clock::time_point stop =
+        std::chrono::steady_clock::now() +
+        std::chrono::microseconds(i_microseconds);
+    while (std::chrono::steady_clock::now() < stop) {
+    }
+}
+
+TEST_CASE("CpuTimeWithinWallTime")
+{
+    for (bool calibrateOverhead : { false, true }) {
+        ProfilerOptions options;
+        options.m_cpuTime = true;
+        options.m_calibrateOverhead = calibrateOverhead;
+        ProfilerSetup(options);
+
+        ProfileCapture capture;
+        {
+            ProfilerSession session(c_regionCount * 2);
+            session.MakeCurrent();
+            for (uint32_t regionIndex = 0; regionIndex < c_regionCount;
+                 ++regionIndex) {
+                {
+                    PROFILE("EmptyScope");
+                }
+                {
+                    PROFILE("BusyScope");
+                    Spin(20);
+                }
+            }
+            ProfilerSession::ClearCurrent();
+            session.Capture(capture);
+        }
+        ProfilerTeardown();
+
+        REQUIRE(capture.m_cpuTime);
+        for (const char* name : { "EmptyScope", "BusyScope" }) {
+            const ProfileSiteStatistics& statistics =
+                capture.m_siteStatistics[FindSite(capture, name)];
+            INFO(name << (calibrateOverhead ? ", calibrated" : ""));
+            CHECK(statistics.m_count == c_regionCount);
+            CHECK(statistics.m_cpuNanoseconds <= statistics.m_totalNanoseconds);
+        }
+    }
+}
+
+TEST_CASE("CalibrationLastRound")
+{
+    // The calibration records every region of its last round, regardless
+    // of the throttling and sampling of the options.
+    ProfilerOptions options;
+    options.m_sampleRate = 4;
+    options.m_throttleCallRate = 100000;
+    options.m_calibrateOverhead = true;
+    ProfilerSetup(options);
+
+    ProfileCapture capture;
+    {
+        ProfilerSession session;
+        session.Capture(capture);
+    }
+    ProfilerTeardown();
+
+    CHECK(capture.m_calibrationRegionCount == 1024);
+    CHECK(capture.m_scopeOverheadNanoseconds > 0.0);
+    CHECK(capture.m_scopeOverheadNanoseconds <=
+          capture.m_nestingOverheadNanoseconds);
+}
+
+TEST_CASE("ThrottlingRecovery")
+{
+    // A limit of 1000 records per second allows 10 records per window.
+    ProfilerOptions options;
+    options.m_throttleCallRate = 1000;
+    ProfilerSetup(options);
+
+    ProfileCapture capture;
+    {
+        ProfilerSession session;
+        session.MakeCurrent();
+
+        // The site records again once a whole window has passed.
+        for (uint32_t regionCount : { 100, 5 }) {
+            for (uint32_t regionIndex = 0; regionIndex < regionCount;
+                 ++regionIndex) {
+                PROFILE("ThrottledScope");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        }
+        ProfilerSession::ClearCurrent();
+        session.Capture(capture);
+    }
+    ProfilerTeardown();
+
+    size_t siteIndex = FindSite(capture, "ThrottledScope");
+    CHECK(capture.m_sites[siteIndex].m_throttled);
+    CHECK(capture.m_siteStatistics[siteIndex].m_count == 105);
+    CHECK(capture.m_records.size() == 15);
+}
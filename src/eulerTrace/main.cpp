@@ -0,0 +1,213 @@
+/// Inspects and converts binary profile traces, as written by
+/// ProfilerExportTrace or by a continuous capture, and the mapping files left
+/// by profiled processes.
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <euler/profileCapture.h>
+#include <euler/profileTrace.h>
+
+/// Print the command-line usage.
+void PrintUsage()
+{
+    printf("usage: euler-trace <command> [options] <trace> [<output>]\n"
+           "\n"
+           "commands:\n"
+           "  summary           print an overview and the statistics of each "
+           "site\n"
+           "  text              print every record\n"
+           "  chrome            convert to the Chrome Trace Event Format\n"
+           "  folded            convert to folded stacks\n"
+           "  trace             write the selected records as a binary trace\n"
+           "\n"
+           "options:\n"
+           "  --site <name>     only keep the sites whose name contains <name>"
+           "\n"
+           "  --thread <index>  only keep the records of thread <index>, and "
+           "derive\n"
+           "                    the statistics from them\n");
+}
+
+/// Selection of records, from the command-line options.
+class RecordFilter
+{
+public:
+    /// Only keep the sites whose name contains this, if not empty.
+    std::string m_site;
+
+    /// Only keep the records of this thread, if not negative.
+    int32_t m_thread = -1;
+};
+
+/// Drop the records and samples of \p io_capture which are not selected by
+/// \p i_filter, along with the statistics of the sites which are not
+/// selected.
+///
+/// The statistics of the selected sites span all the threads, so they are
+/// derived from the selected records when filtering by thread, without the
+/// CPU time and allocations which are only measured per site.
+void ApplyFilter(const RecordFilter& i_filter, ProfileCapture& io_capture)
+{
+    std::vector<bool> selectedSites(io_capture.m_sites.size(), true);
+    if (!i_filter.m_site.empty()) {
+        for (size_t siteIndex = 0; siteIndex < io_capture.m_sites.size();
+             ++siteIndex) {
+            selectedSites[siteIndex] =
+                io_capture.m_sites[siteIndex].m_name.find(i_filter.m_site) !=
+                std::string::npos;
+            if (!selectedSites[siteIndex]) {
+                io_capture.m_siteStatistics[siteIndex] =
+                    ProfileSiteStatistics();
+            }
+        }
+    }
+
+    io_capture.m_records.erase(
+        std::remove_if(io_capture.m_records.begin(),
+                       io_capture.m_records.end(),
+                       [&](const ProfileRecord& i_record) {
+                           return !selectedSites[i_record.m_site] ||
+                                  (i_filter.m_thread >= 0 &&
+                                   i_record.m_thread != i_filter.m_thread);
+                       }),
+        io_capture.m_records.end());
+    io_capture.m_samples.erase(
+        std::remove_if(io_capture.m_samples.begin(),
+                       io_capture.m_samples.end(),
+                       [&](const ProfileSample& i_sample) {
+                           // The ends of spans are left to their beginning.
+                           bool selected =
+                               i_sample.m_kind == ProfileSampleKind::AsyncEnd ||
+                               selectedSites[i_sample.m_site];
+                           return !selected ||
+                                  (i_filter.m_thread >= 0 &&
+                                   i_sample.m_thread != i_filter.m_thread);
+                       }),
+        io_capture.m_samples.end());
+
+    if (i_filter.m_thread >= 0) {
+        ProfileCaptureComputeStatistics(io_capture);
+        io_capture.m_cpuTime = false;
+        io_capture.m_allocations = false;
+    }
+}
+
+/// Print an overview of \p i_capture, followed by the statistics of each of
+/// its sites.
+void PrintSummary(const ProfileCapture& i_capture)
+{
+    std::vector<uint64_t> threadRecordCounts;
+    uint64_t firstStart = UINT64_MAX;
+    uint64_t lastStop = 0;
+    for (const ProfileRecord& record : i_capture.m_records) {
+        if (record.m_thread >= threadRecordCounts.size()) {
+            threadRecordCounts.resize(record.m_thread + 1);
+        }
+        ++threadRecordCounts[record.m_thread];
+        firstStart = std::min(firstStart, record.m_start);
+        lastStop = std::max(lastStop, record.m_stop);
+    }
+
+    printf("=== Trace Summary ===\n");
+    printf("Records:         %zu\n", i_capture.m_records.size());
+    printf("Samples:         %zu\n", i_capture.m_samples.size());
+    printf("Dropped records: %" PRIu64 "\n", i_capture.m_droppedRecordCount);
+    printf("Sites:           %zu\n", i_capture.m_sites.size());
+    printf("Duration (ns):   %" PRIu64 "\n",
+           lastStop > firstStart
+               ? i_capture.TicksToNanoseconds(lastStop - firstStart)
+               : 0);
+    for (size_t threadIndex = 0; threadIndex < threadRecordCounts.size();
+         ++threadIndex) {
+        if (threadRecordCounts[threadIndex] > 0) {
+            printf("Thread %zu:        %" PRIu64 " records\n",
+                   threadIndex,
+                   threadRecordCounts[threadIndex]);
+        }
+    }
+    printf("\n");
+
+    // Regions of a mapping file which never closed, as the process crashed.
+    if (!i_capture.m_openRecords.empty()) {
+        printf("=== Open Regions ===\n");
+        for (const ProfileRecord& record : i_capture.m_openRecords) {
+            printf("Thread %u: %*s%s\n",
+                   record.m_thread,
+                   record.m_stack * 2,
+                   "",
+                   i_capture.m_sites[record.m_site].m_name.c_str());
+        }
+        printf("\n");
+    }
+
+    ProfileCapturePrintStatistics(i_capture);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Gather the positional arguments, and the options in between.
+    std::string command = argv[1];
+    RecordFilter filter;
+    std::vector<const char*> arguments;
+    for (int argIndex = 2; argIndex < argc; ++argIndex) {
+        if (strcmp(argv[argIndex], "--site") == 0 && argIndex + 1 < argc) {
+            filter.m_site = argv[++argIndex];
+        } else if (strcmp(argv[argIndex], "--thread") == 0 &&
+                   argIndex + 1 < argc) {
+            filter.m_thread = atoi(argv[++argIndex]);
+        } else {
+            arguments.push_back(argv[argIndex]);
+        }
+    }
+
+    bool hasOutput = command == "chrome" || command == "folded" ||
+                     command == "trace";
+    if (arguments.size() != (hasOutput ? 2 : 1)) {
+        PrintUsage();
+        return 1;
+    }
+
+    const char* tracePath = arguments[0];
+    ProfileCapture capture;
+    if (!ProfileTraceRead(tracePath, capture)) {
+        fprintf(stderr, "euler-trace: could not read %s\n", tracePath);
+        if (capture.m_records.empty()) {
+            return 1;
+        }
+    }
+    ApplyFilter(filter, capture);
+
+    bool succeeded = true;
+    if (command == "summary") {
+        PrintSummary(capture);
+    } else if (command == "text") {
+        ProfileCapturePrint(capture);
+    } else if (command == "chrome") {
+        succeeded = ProfileCaptureExportChromeTrace(capture, arguments[1]);
+    } else if (command == "folded") {
+        succeeded = ProfileCaptureExportFoldedStacks(capture, arguments[1]);
+    } else if (command == "trace") {
+        succeeded = ProfileCaptureExportTrace(capture, arguments[1]);
+    } else {
+        PrintUsage();
+        return 1;
+    }
+
+    if (!succeeded) {
+        fprintf(stderr, "euler-trace: could not write %s\n", arguments[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -46,6 +46,6 @@ int main()
     printf("The largest prime factor of %lu is %lu\n", number, maxPrimeFactor);
     ASSERT(maxPrimeFactor == 6857);
 
-    PROFILER_PRINT();
+    PROFILER_PRINT_STATISTICS();
     PROFILER_TEARDOWN();
 }
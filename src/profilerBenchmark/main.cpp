@@ -0,0 +1,158 @@
+/// Measures the overhead of the profiler itself.
+///
+/// Each benchmark profiles one scope per iteration, so that Catch2 reports the
+/// mean and standard deviation of the cost of a scope, in nanoseconds.  Run
+/// with --benchmark-samples to trade accuracy for time.  The wraparound
+/// benchmark also reports the memory used by the profiler at each capacity.
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+// The signal handlers of the bundled Catch2 do not compile against recent
+// glibc, whose MINSIGSTKSZ is not a constant.
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <euler/profiler.h>
+
+/// Number of records allocated per thread, unless stated otherwise.
+constexpr uint32_t c_recordCapacity = 1 << 16;
+
+/// Number of scopes left open around the measured scope of the nested
+/// benchmark.
+constexpr uint32_t c_nestingDepth = 8;
+
+/// Return the human-readable name of \p i_clock.
+const char* GetClockName(ProfilerClock i_clock)
+{
+    switch (i_clock) {
+        case ProfilerClock::Monotonic:
+            return "Monotonic";
+        case ProfilerClock::TSC:
+            return "TSC";
+    }
+
+    return "Unknown";
+}
+
+/// Set up the profiler with \p i_capacity records per thread, timed by
+/// \p i_clock.
+void SetupProfiler(uint32_t i_capacity, ProfilerClock i_clock)
+{
+    ProfilerOptions options;
+    options.m_capacity = i_capacity;
+    options.m_clock = i_clock;
+    ProfilerSetup(options);
+}
+
+/// Open \p i_depth nested scopes, then measure a scope within them.
+void MeasureNestedScope(uint32_t i_depth)
+{
+    PROFILE("EnclosingScope");
+    if (i_depth > 1) {
+        MeasureNestedScope(i_depth - 1);
+        return;
+    }
+
+    BENCHMARK("Scope nested " + std::to_string(c_nestingDepth) + " deep")
+    {
+        PROFILE("NestedScope");
+    };
+}
+
+TEST_CASE("EmptyScope")
+{
+    for (ProfilerClock clock :
+         { ProfilerClock::Monotonic, ProfilerClock::TSC }) {
+        SetupProfiler(c_recordCapacity, clock);
+        BENCHMARK(std::string("Empty scope, ") +
+                  GetClockName(ProfilerGetClock()))
+        {
+            PROFILE("EmptyScope");
+        };
+        PROFILER_TEARDOWN();
+    }
+}
+
+TEST_CASE("NestedScope")
+{
+    SetupProfiler(c_recordCapacity, ProfilerClock::TSC);
+    MeasureNestedScope(c_nestingDepth);
+    PROFILER_TEARDOWN();
+}
+
+TEST_CASE("SessionScope")
+{
+    // Scopes are recorded into a session current on the calling thread,
+    // rather than into the set-up profiler.
+    SetupProfiler(c_recordCapacity, ProfilerClock::TSC);
+    ProfilerSession session(c_recordCapacity);
+    session.MakeCurrent();
+    BENCHMARK("Empty scope, current session")
+    {
+        PROFILE("SessionScope");
+    };
+    ProfilerSession::ClearCurrent();
+    PROFILER_TEARDOWN();
+}
+
+TEST_CASE("Wraparound")
+{
+    // The smaller rings wrap around every few scopes, while the larger ones
+    // outgrow the caches.
+    for (uint32_t capacity : { 16u, 1024u, 1u << 20 }) {
+        SetupProfiler(capacity, ProfilerClock::TSC);
+        BENCHMARK("Empty scope, capacity of " + std::to_string(capacity))
+        {
+            PROFILE("WraparoundScope");
+        };
+        WARN("Capacity of " << capacity << ": " << ProfilerGetMemoryUsage()
+                            << " bytes used by the profiler");
+        PROFILER_TEARDOWN();
+    }
+}
+
+TEST_CASE("ContendedCheckout")
+{
+    // Scopes are measured on the calling thread, while the other threads keep
+    // profiling scopes of their own.
+    uint32_t maxThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threadCount = 1; threadCount < maxThreadCount;
+         threadCount *= 2) {
+        threadCounts.push_back(threadCount);
+    }
+    threadCounts.push_back(maxThreadCount);
+
+    for (uint32_t threadCount : threadCounts) {
+        SetupProfiler(c_recordCapacity, ProfilerClock::TSC);
+
+        std::atomic_bool stopping{ false };
+        std::vector<std::thread> threads;
+        for (uint32_t threadIndex = 1; threadIndex < threadCount;
+             ++threadIndex) {
+            threads.emplace_back([&stopping]() {
+                while (!stopping.load(std::memory_order_relaxed)) {
+                    PROFILE("ContendingScope");
+                }
+            });
+        }
+
+        BENCHMARK("Empty scope, " + std::to_string(threadCount) + " threads")
+        {
+            PROFILE("ContendedScope");
+        };
+
+        stopping.store(true, std::memory_order_relaxed);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        PROFILER_TEARDOWN();
+    }
+}